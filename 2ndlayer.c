@@ -61,7 +61,9 @@ Matrix* readMatrixFromCSV(const char* filename) {
     int rows = 0, cols = 0;
     char line[4096];
 
+    // Blank lines are skipped here and below
     while (fgets(line, sizeof(line), file)) {
+        if (strspn(line, " \t\r\n") == strlen(line)) continue;
         rows++;
         if (rows == 1) {
             char* token = strtok(line, ",");
@@ -69,7 +71,6 @@ Matrix* readMatrixFromCSV(const char* filename) {
                 cols++;
                 token = strtok(NULL, ",");
             }
-            rewind(file);
         }
     }
 
@@ -78,6 +79,10 @@ Matrix* readMatrixFromCSV(const char* filename) {
     rewind(file);
     for (int i = 0; i < rows; i++) {
         if (!fgets(line, sizeof(line), file)) break;
+        if (strspn(line, " \t\r\n") == strlen(line)) {
+            i--;
+            continue;
+        }
         char* token = strtok(line, ",");
         for (int j = 0; j < cols && token; j++) {
             matrix->data[i][j] = atof(token);
@@ -139,6 +144,277 @@ Matrix* convolve(Matrix* input, Matrix* filter, int stride, ActivationFunction a
     return output;
 }
 
+// A filter approximated by rank terms: filter ~= sum over k of
+// columns->data[k][m] * rows->data[k][n], singular values folded into columns
+typedef struct {
+    int rank;
+    Matrix* columns;
+    Matrix* rows;
+} SeparableFilter;
+
+// Relative Frobenius error allowed when dropping singular values; below 0
+// every filter is applied directly. The default only drops what rounding
+// leaves of an exactly low-rank filter.
+double separableTolerance = 1e-12;
+
+// Factors a filter with a one-sided Jacobi SVD and keeps the fewest terms
+// whose dropped singular values stay within separableTolerance of the
+// filter's norm. Returns NULL when rank * (rows + cols) multiplies per output
+// would not beat the direct rows * cols.
+SeparableFilter* separateFilter(Matrix* filter) {
+    if (separableTolerance < 0) return NULL;
+
+    int rows = filter->rows;
+    int cols = filter->cols;
+    Matrix* u = createMatrix(rows, cols);
+    Matrix* v = createMatrix(cols, cols);
+    for (int m = 0; m < rows; m++) {
+        for (int n = 0; n < cols; n++) {
+            u->data[m][n] = filter->data[m][n];
+        }
+    }
+    for (int n = 0; n < cols; n++) {
+        v->data[n][n] = 1;
+    }
+
+    // Rotate column pairs of u (and v alongside) until all are orthogonal;
+    // then u = filter * v and the column norms are the singular values
+    for (int sweep = 0; sweep < 60; sweep++) {
+        int rotated = 0;
+        for (int p = 0; p < cols - 1; p++) {
+            for (int q = p + 1; q < cols; q++) {
+                double alpha = 0, beta = 0, gamma = 0;
+                for (int m = 0; m < rows; m++) {
+                    alpha += u->data[m][p] * u->data[m][p];
+                    beta += u->data[m][q] * u->data[m][q];
+                    gamma += u->data[m][p] * u->data[m][q];
+                }
+                if (fabs(gamma) <= 1e-15 * sqrt(alpha * beta)) continue;
+
+                double zeta = (beta - alpha) / (2 * gamma);
+                double t = (zeta >= 0 ? 1 : -1) / (fabs(zeta) + sqrt(1 + zeta * zeta));
+                double c = 1 / sqrt(1 + t * t);
+                double s = c * t;
+                for (int m = 0; m < rows; m++) {
+                    double up = u->data[m][p];
+                    u->data[m][p] = c * up - s * u->data[m][q];
+                    u->data[m][q] = s * up + c * u->data[m][q];
+                }
+                for (int n = 0; n < cols; n++) {
+                    double vp = v->data[n][p];
+                    v->data[n][p] = c * vp - s * v->data[n][q];
+                    v->data[n][q] = s * vp + c * v->data[n][q];
+                }
+                rotated = 1;
+            }
+        }
+        if (!rotated) break;
+    }
+
+    // Order the terms by singular value, largest first
+    int order[cols];
+    double sigma[cols];
+    double total = 0;
+    for (int n = 0; n < cols; n++) {
+        sigma[n] = 0;
+        for (int m = 0; m < rows; m++) {
+            sigma[n] += u->data[m][n] * u->data[m][n];
+        }
+        total += sigma[n];
+        int k = n;
+        while (k > 0 && sigma[order[k - 1]] < sigma[n]) {
+            order[k] = order[k - 1];
+            k--;
+        }
+        order[k] = n;
+    }
+
+    // Sum the dropped terms from the smallest up so rounding in the large
+    // ones does not swamp them
+    int rank = cols;
+    double dropped = 0;
+    while (rank > 0 && dropped + sigma[order[rank - 1]] <= separableTolerance * separableTolerance * total) {
+        dropped += sigma[order[rank - 1]];
+        rank--;
+    }
+
+    SeparableFilter* separable = NULL;
+    if (rank * (rows + cols) < rows * cols) {
+        separable = (SeparableFilter*)malloc(sizeof(SeparableFilter));
+        if (!separable) {
+            fprintf(stderr, "Memory allocation failed for separable filter\n");
+            exit(EXIT_FAILURE);
+        }
+        separable->rank = rank;
+        separable->columns = createMatrix(rank, rows);
+        separable->rows = createMatrix(rank, cols);
+        for (int k = 0; k < rank; k++) {
+            for (int m = 0; m < rows; m++) {
+                separable->columns->data[k][m] = u->data[m][order[k]];
+            }
+            for (int n = 0; n < cols; n++) {
+                separable->rows->data[k][n] = v->data[n][order[k]];
+            }
+        }
+    }
+
+    freeMatrix(u);
+    freeMatrix(v);
+    return separable;
+}
+
+void freeSeparableFilter(SeparableFilter* separable) {
+    if (!separable) return;
+    freeMatrix(separable->columns);
+    freeMatrix(separable->rows);
+    free(separable);
+}
+
+// convolve() for a separated filter: per term, a row pass over the input
+// rows the output reads, then a column pass accumulating into the output
+Matrix* convolveSeparable(Matrix* input, SeparableFilter* separable, int stride) {
+    int filterRows = separable->columns->cols;
+    int filterCols = separable->rows->cols;
+    int outputRows = ((input->rows - filterRows) / stride) + 1;
+    int outputCols = ((input->cols - filterCols) / stride) + 1;
+
+    if (outputRows <= 0 || outputCols <= 0) {
+        fprintf(stderr, "Invalid convolution dimensions\n");
+        return NULL;
+    }
+
+    Matrix* output = createMatrix(outputRows, outputCols);
+    Matrix* rowSums = createMatrix((outputRows - 1) * stride + filterRows, outputCols);
+
+    for (int k = 0; k < separable->rank; k++) {
+        double* row = separable->rows->data[k];
+        double* column = separable->columns->data[k];
+        for (int i = 0; i < rowSums->rows; i++) {
+            for (int j = 0; j < outputCols; j++) {
+                double sum = 0;
+                for (int n = 0; n < filterCols; n++) {
+                    sum += input->data[i][j * stride + n] * row[n];
+                }
+                rowSums->data[i][j] = sum;
+            }
+        }
+        for (int i = 0; i < outputRows; i++) {
+            for (int j = 0; j < outputCols; j++) {
+                double sum = 0;
+                for (int m = 0; m < filterRows; m++) {
+                    sum += rowSums->data[i * stride + m][j] * column[m];
+                }
+                output->data[i][j] += sum;
+            }
+        }
+    }
+
+    for (int i = 0; i < outputRows; i++) {
+        for (int j = 0; j < outputCols; j++) {
+            output->data[i][j] = (output->data[i][j] > 0) ? output->data[i][j] : 0;
+        }
+    }
+
+    freeMatrix(rowSums);
+    return output;
+}
+
+// Winograd minimal filtering F(2x2, 3x3): each 2x2 output tile is
+// AT * (U .* (BT * d * B)) * A for its 4x4 input tile d, with the filter
+// transformed once into U = G * g * GT. 16 multiplies per tile instead of 36.
+const double winogradBT[4][4] = {
+    {1,  0, -1,  0},
+    {0,  1,  1,  0},
+    {0, -1,  1,  0},
+    {0,  1,  0, -1}
+};
+const double winogradG[4][3] = {
+    {1,    0,   0},
+    {0.5,  0.5, 0.5},
+    {0.5, -0.5, 0.5},
+    {0,    0,   1}
+};
+const double winogradAT[2][4] = {
+    {1, 1,  1,  0},
+    {0, 1, -1, -1}
+};
+
+// U = G * filter * GT for a 3x3 filter
+void transformFilter(Matrix* filter, double U[4][4]) {
+    double Gg[4][3];
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 3; j++) {
+            Gg[i][j] = 0;
+            for (int k = 0; k < 3; k++) Gg[i][j] += winogradG[i][k] * filter->data[k][j];
+        }
+    }
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            U[i][j] = 0;
+            for (int k = 0; k < 3; k++) U[i][j] += Gg[i][k] * winogradG[j][k];
+        }
+    }
+}
+
+// convolve() at stride 1 for a 3x3 filter transformed by transformFilter().
+// Tiles past the input edge read zeros and keep only their valid outputs.
+// Results differ from the direct sums only by rounding.
+Matrix* convolveWinograd(Matrix* input, double U[4][4]) {
+    int outputRows = input->rows - 2;
+    int outputCols = input->cols - 2;
+
+    if (outputRows <= 0 || outputCols <= 0) {
+        fprintf(stderr, "Invalid convolution dimensions\n");
+        return NULL;
+    }
+
+    Matrix* output = createMatrix(outputRows, outputCols);
+    double d[4][4], tmp[4][4], V[4][4];
+
+    for (int ti = 0; ti < outputRows; ti += 2) {
+        for (int tj = 0; tj < outputCols; tj += 2) {
+            for (int i = 0; i < 4; i++) {
+                for (int j = 0; j < 4; j++) {
+                    int r = ti + i, c = tj + j;
+                    d[i][j] = r < input->rows && c < input->cols ? input->data[r][c] : 0;
+                }
+            }
+
+            // V = BT * d * B, then V .* U
+            for (int i = 0; i < 4; i++) {
+                for (int j = 0; j < 4; j++) {
+                    tmp[i][j] = 0;
+                    for (int k = 0; k < 4; k++) tmp[i][j] += winogradBT[i][k] * d[k][j];
+                }
+            }
+            for (int i = 0; i < 4; i++) {
+                for (int j = 0; j < 4; j++) {
+                    V[i][j] = 0;
+                    for (int k = 0; k < 4; k++) V[i][j] += tmp[i][k] * winogradBT[j][k];
+                    V[i][j] *= U[i][j];
+                }
+            }
+
+            // Y = AT * V * A, then the relu convolve() applies
+            for (int i = 0; i < 2; i++) {
+                for (int j = 0; j < 4; j++) {
+                    tmp[i][j] = 0;
+                    for (int k = 0; k < 4; k++) tmp[i][j] += winogradAT[i][k] * V[k][j];
+                }
+            }
+            for (int i = 0; i < 2 && ti + i < outputRows; i++) {
+                for (int j = 0; j < 2 && tj + j < outputCols; j++) {
+                    double sum = 0;
+                    for (int k = 0; k < 4; k++) sum += tmp[i][k] * winogradAT[j][k];
+                    output->data[ti + i][tj + j] = (sum > 0) ? sum : 0;
+                }
+            }
+        }
+    }
+
+    return output;
+}
+
 Matrix* maxPooling(Matrix* input, int poolSize) {
     int outputRows = input->rows / poolSize;
     int outputCols = input->cols / poolSize;
@@ -181,10 +457,23 @@ void printMatrix(Matrix* matrix) {
     }
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     const char* inputFile = "input.csv";
     const char* filtersFile = "filters.csv";
 
+    // --separable-tolerance <error> sets the relative error allowed when
+    // filters are split into row and column passes; -1 disables splitting
+    for (int i = 1; i < argc; i++) {
+        char* end = NULL;
+        if (strcmp(argv[i], "--separable-tolerance") == 0 && i + 1 < argc) {
+            separableTolerance = strtod(argv[++i], &end);
+        }
+        if (!end || end == argv[i] || *end) {
+            fprintf(stderr, "Usage: %s [--separable-tolerance <relative error, -1 to disable>]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
     Matrix* inputMatrix = readMatrixFromCSV(inputFile);
     if (!inputMatrix) {
         fprintf(stderr, "Failed to read input matrix\n");
@@ -200,13 +489,24 @@ int main() {
 
     int stride = 1;
     int poolSize = 1;
+    int numLayers = 2;
+    int numFilters = 2;
+
+    // Filters are square, filterSize rows of filterSize values each, stacked
+    // layer by layer in filters.csv
+    int filterSize = filtersMatrix->cols;
+    if (filtersMatrix->rows < numLayers * numFilters * filterSize) {
+        fprintf(stderr, "filters.csv needs %d rows of %d values for %d layers of %d filters\n",
+                numLayers * numFilters * filterSize, filterSize, numLayers, numFilters);
+        freeMatrix(inputMatrix);
+        freeMatrix(filtersMatrix);
+        return EXIT_FAILURE;
+    }
 
     Matrix* currentInput = inputMatrix;
     int filterOffset = 0;
 
-    for (int layer = 0; layer < 2; layer++) {
-        int filterSize = 2;  
-        int numFilters = 2; 
+    for (int layer = 0; layer < numLayers; layer++) {
 
         Matrix* layerOutput = NULL;
 
@@ -219,7 +519,19 @@ int main() {
             }
 
             printf("\nConvolution Result for Layer %d Filter %d:\n", layer + 1, f + 1);
-            Matrix* result = convolve(currentInput, currentFilter, stride, relu);
+            // 3x3 filters at stride 1 take the Winograd path, which beats
+            // even a rank-1 split
+            Matrix* result;
+            if (filterSize == 3 && stride == 1) {
+                double transformed[4][4];
+                transformFilter(currentFilter, transformed);
+                result = convolveWinograd(currentInput, transformed);
+            } else {
+                SeparableFilter* separable = separateFilter(currentFilter);
+                result = separable ? convolveSeparable(currentInput, separable, stride)
+                                   : convolve(currentInput, currentFilter, stride, relu);
+                freeSeparableFilter(separable);
+            }
 
             if (result) {
                 printMatrix(result);
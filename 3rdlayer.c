@@ -1,254 +1,500 @@
+// Command-line driver for the filter chain network. Build with
+//
+//   gcc -O2 -o 3rdlayer 3rdlayer.c libcnn.c -lm -lpthread
+
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <stdarg.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <stdatomic.h>
+#include "cnncore.h"
+
+// Shortest round-trip float formatting (Ryu, Adams 2018). The 5^i tables are
+// computed once at startup with 128-bit arithmetic instead of being embedded.
+#define FLOAT_POW5_INV_BITCOUNT 59
+#define FLOAT_POW5_BITCOUNT 61
+#define FLOAT_POW5_INV_TABLE_SIZE 31
+#define FLOAT_POW5_TABLE_SIZE 47
+
+static uint64_t floatPow5InvSplit[FLOAT_POW5_INV_TABLE_SIZE];
+static uint64_t floatPow5Split[FLOAT_POW5_TABLE_SIZE];
+static int floatPow5TablesReady = 0;
+
+// ceil(log2(5^e)), or 1 when e == 0
+int32_t pow5bits(int32_t e) {
+    return (int32_t)(((uint32_t)e * 1217359) >> 19) + 1;
+}
 
-typedef struct {
-    int rows;
-    int cols;
-    float** data;
-} Matrix;
-
-Matrix* createMatrix(int rows, int cols) {
-    Matrix* matrix = (Matrix*)malloc(sizeof(Matrix));
-    if (!matrix) {
-        fprintf(stderr, "Memory allocation failed for matrix structure\n");
-        exit(EXIT_FAILURE);
-    }
-
-    matrix->rows = rows;
-    matrix->cols = cols;
+uint32_t log10Pow2(int32_t e) {
+    return ((uint32_t)e * 78913) >> 18;
+}
 
-    matrix->data = (float**)malloc(rows * sizeof(float*));
-    if (!matrix->data) {
-        free(matrix);
-        fprintf(stderr, "Memory allocation failed for matrix rows\n");
-        exit(EXIT_FAILURE);
-    }
+uint32_t log10Pow5(int32_t e) {
+    return ((uint32_t)e * 732923) >> 20;
+}
 
-    for (int i = 0; i < rows; i++) {
-        matrix->data[i] = (float*)calloc(cols, sizeof(float));
-        if (!matrix->data[i]) {
-            for (int j = 0; j < i; j++) {
-                free(matrix->data[j]);
+void initFloatFormatTables(void) {
+    if (floatPow5TablesReady) return;
+
+    unsigned __int128 pow5 = 1;
+    for (int i = 0; i < FLOAT_POW5_TABLE_SIZE; i++) {
+        int bits = pow5bits(i);
+        floatPow5Split[i] = bits >= FLOAT_POW5_BITCOUNT ? (uint64_t)(pow5 >> (bits - FLOAT_POW5_BITCOUNT))
+                                                        : (uint64_t)(pow5 << (FLOAT_POW5_BITCOUNT - bits));
+
+        if (i < FLOAT_POW5_INV_TABLE_SIZE) {
+            // floor(2^shift / 5^i) + 1 by binary long division; the remainder
+            // stays below 5^i < 2^127 and the quotient fits in 64 bits
+            int shift = bits - 1 + FLOAT_POW5_INV_BITCOUNT;
+            unsigned __int128 remainder = 1;
+            uint64_t quotient = 0;
+            for (int b = 0; b < shift; b++) {
+                remainder <<= 1;
+                quotient <<= 1;
+                if (remainder >= pow5) {
+                    remainder -= pow5;
+                    quotient |= 1;
+                }
             }
-            free(matrix->data);
-            free(matrix);
-            fprintf(stderr, "Memory allocation failed for matrix columns\n");
-            exit(EXIT_FAILURE);
+            if (pow5 == 1) quotient = (uint64_t)1 << shift;
+            floatPow5InvSplit[i] = quotient + 1;
         }
+        pow5 *= 5;
     }
 
-    return matrix;
+    floatPow5TablesReady = 1;
 }
 
-void freeMatrix(Matrix* matrix) {
-    if (!matrix) return;
-
-    for (int i = 0; i < matrix->rows; i++) {
-        free(matrix->data[i]);
+uint32_t pow5Factor32(uint32_t value) {
+    uint32_t count = 0;
+    while (value % 5 == 0) {
+        value /= 5;
+        count++;
     }
-    free(matrix->data);
-    free(matrix);
+    return count;
 }
 
-Matrix* readMatrixFromCSV(const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "Error opening file: %s\n", filename);
-        return NULL;
-    }
+uint32_t mulShift32(uint32_t m, uint64_t factor, int32_t shift) {
+    uint64_t bits0 = (uint64_t)m * (uint32_t)factor;
+    uint64_t bits1 = (uint64_t)m * (uint32_t)(factor >> 32);
+    uint64_t sum = (bits0 >> 32) + bits1;
+    return (uint32_t)(sum >> (shift - 32));
+}
 
-    const int maxValues = 2000; 
-    float* tempData = (float*)malloc(maxValues * sizeof(float));
-    if (!tempData) {
-        fprintf(stderr, "Memory allocation failed for temporary storage\n");
-        fclose(file);
-        return NULL;
+// Shortest decimal digits and exponent with digits * 10^exponent == value
+// after rounding to float. value must be finite and non-zero.
+void floatToDecimal(float value, uint32_t* digits, int32_t* exponent) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t ieeeMantissa = bits & ((1u << 23) - 1);
+    uint32_t ieeeExponent = (bits >> 23) & 0xff;
+
+    int32_t e2;
+    uint32_t m2;
+    if (ieeeExponent == 0) {
+        e2 = 1 - 127 - 23 - 2;
+        m2 = ieeeMantissa;
+    } else {
+        e2 = (int32_t)ieeeExponent - 127 - 23 - 2;
+        m2 = (1u << 23) | ieeeMantissa;
     }
-
-    int totalValues = 0;
-    char line[8192]; 
-
-    while (fgets(line, sizeof(line), file)) {
-        char* token = strtok(line, ", \n");
-        while (token) {
-            if (totalValues < maxValues) {
-                tempData[totalValues] = atof(token);
-                totalValues++;
+    int acceptBounds = (m2 & 1) == 0;
+
+    // Interval of decimal representations that round back to value
+    uint32_t mv = 4 * m2;
+    uint32_t mp = 4 * m2 + 2;
+    uint32_t mmShift = ieeeMantissa != 0 || ieeeExponent <= 1;
+    uint32_t mm = 4 * m2 - 1 - mmShift;
+
+    uint32_t vr, vp, vm;
+    int32_t e10;
+    int vmIsTrailingZeros = 0, vrIsTrailingZeros = 0;
+    uint8_t lastRemovedDigit = 0;
+
+    if (e2 >= 0) {
+        uint32_t q = log10Pow2(e2);
+        e10 = (int32_t)q;
+        int32_t k = FLOAT_POW5_INV_BITCOUNT + pow5bits((int32_t)q) - 1;
+        int32_t i = -e2 + (int32_t)q + k;
+        vr = mulShift32(mv, floatPow5InvSplit[q], i);
+        vp = mulShift32(mp, floatPow5InvSplit[q], i);
+        vm = mulShift32(mm, floatPow5InvSplit[q], i);
+        if (q != 0 && (vp - 1) / 10 <= vm / 10) {
+            int32_t l = FLOAT_POW5_INV_BITCOUNT + pow5bits((int32_t)(q - 1)) - 1;
+            lastRemovedDigit = (uint8_t)(mulShift32(mv, floatPow5InvSplit[q - 1], -e2 + (int32_t)q - 1 + l) % 10);
+        }
+        if (q <= 9) {
+            // At most one of mp, mv and mm is a multiple of 5
+            if (mv % 5 == 0) {
+                vrIsTrailingZeros = pow5Factor32(mv) >= q;
+            } else if (acceptBounds) {
+                vmIsTrailingZeros = pow5Factor32(mm) >= q;
             } else {
-                fprintf(stderr, "Exceeded maximum expected values\n");
-                break;
+                vp -= pow5Factor32(mp) >= q;
             }
-            token = strtok(NULL, ", \n");
+        }
+    } else {
+        uint32_t q = log10Pow5(-e2);
+        e10 = (int32_t)q + e2;
+        int32_t i = -e2 - (int32_t)q;
+        int32_t k = pow5bits(i) - FLOAT_POW5_BITCOUNT;
+        int32_t j = (int32_t)q - k;
+        vr = mulShift32(mv, floatPow5Split[i], j);
+        vp = mulShift32(mp, floatPow5Split[i], j);
+        vm = mulShift32(mm, floatPow5Split[i], j);
+        if (q != 0 && (vp - 1) / 10 <= vm / 10) {
+            j = (int32_t)q - 1 - (pow5bits(i + 1) - FLOAT_POW5_BITCOUNT);
+            lastRemovedDigit = (uint8_t)(mulShift32(mv, floatPow5Split[i + 1], j) % 10);
+        }
+        if (q <= 1) {
+            // mv = 4 * m2 always has at least two trailing zero bits
+            vrIsTrailingZeros = 1;
+            if (acceptBounds) {
+                vmIsTrailingZeros = mmShift == 1;
+            } else {
+                vp--;
+            }
+        } else if (q < 31) {
+            vrIsTrailingZeros = (mv & ((1u << (q - 1)) - 1)) == 0;
         }
     }
 
-    fclose(file);
-
-    Matrix* matrix = createMatrix(1, totalValues); 
-    for (int i = 0; i < totalValues; i++) {
-        matrix->data[0][i] = tempData[i];
+    // Drop digits while the interval still contains a shorter representation
+    int32_t removed = 0;
+    uint32_t output;
+    if (vmIsTrailingZeros || vrIsTrailingZeros) {
+        while (vp / 10 > vm / 10) {
+            vmIsTrailingZeros &= vm % 10 == 0;
+            vrIsTrailingZeros &= lastRemovedDigit == 0;
+            lastRemovedDigit = (uint8_t)(vr % 10);
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        if (vmIsTrailingZeros) {
+            while (vm % 10 == 0) {
+                vrIsTrailingZeros &= lastRemovedDigit == 0;
+                lastRemovedDigit = (uint8_t)(vr % 10);
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+                removed++;
+            }
+        }
+        if (vrIsTrailingZeros && lastRemovedDigit == 5 && vr % 2 == 0) {
+            // Round half to even when the exact value ends in 50...0
+            lastRemovedDigit = 4;
+        }
+        output = vr + ((vr == vm && (!acceptBounds || !vmIsTrailingZeros)) || lastRemovedDigit >= 5);
+    } else {
+        while (vp / 10 > vm / 10) {
+            lastRemovedDigit = (uint8_t)(vr % 10);
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        output = vr + (vr == vm || lastRemovedDigit >= 5);
     }
 
-    free(tempData);
-
-    return matrix;
+    *digits = output;
+    *exponent = e10 + removed;
 }
 
-Matrix* readFiltersFromCSV(const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "Error opening file: %s\n", filename);
-        return NULL;
+// Writes the shortest text that parses back to exactly value (no terminator)
+// and returns its length; at most FORMAT_FLOAT_MAX characters. Plain decimal
+// notation is used for magnitudes from 1e-6 up to 1e9, scientific otherwise.
+#define FORMAT_FLOAT_MAX 16
+
+int formatFloat(float value, char* out) {
+    char* p = out;
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    if (isnan(value)) {
+        memcpy(out, "nan", 3);
+        return 3;
+    }
+    if (bits >> 31) *p++ = '-';
+    if (isinf(value)) {
+        memcpy(p, "inf", 3);
+        return (int)(p - out) + 3;
+    }
+    if ((bits & 0x7fffffff) == 0) {
+        *p++ = '0';
+        return (int)(p - out);
     }
 
-    int rows = 0, cols = 0;
-    char line[4096];
-    
-    while (fgets(line, sizeof(line), file)) {
-        rows++;
-        if (rows == 1) {
-            char* token = strtok(line, ",");
-            while (token) {
-                cols++;
-                token = strtok(NULL, ",");
-            }
-            rewind(file);
+    uint32_t digits;
+    int32_t exponent;
+    floatToDecimal(value, &digits, &exponent);
+
+    char digitText[10];
+    int length = 0;
+    do {
+        digitText[9 - length] = (char)('0' + digits % 10);
+        digits /= 10;
+        length++;
+    } while (digits);
+    const char* d = digitText + 10 - length;
+
+    // Number of digits before the decimal point
+    int point = length + exponent;
+
+    if (exponent >= 0 && point <= 9) {
+        memcpy(p, d, length);
+        p += length;
+        for (int i = 0; i < exponent; i++) *p++ = '0';
+    } else if (exponent < 0 && point > 0) {
+        memcpy(p, d, point);
+        p += point;
+        *p++ = '.';
+        memcpy(p, d + point, length - point);
+        p += length - point;
+    } else if (exponent < 0 && point > -6) {
+        *p++ = '0';
+        *p++ = '.';
+        for (int i = 0; i < -point; i++) *p++ = '0';
+        memcpy(p, d, length);
+        p += length;
+    } else {
+        *p++ = d[0];
+        if (length > 1) {
+            *p++ = '.';
+            memcpy(p, d + 1, length - 1);
+            p += length - 1;
         }
-    }
-    Matrix* matrix = createMatrix(rows, cols);
-    rewind(file);
-    for (int i = 0; i < rows; i++) {
-        if (!fgets(line, sizeof(line), file)) break;
-        
-        char* token = strtok(line, ",");
-        for (int j = 0; j < cols && token; j++) {
-            matrix->data[i][j] = atof(token);
-            token = strtok(NULL, ",");
+        int scientific = point - 1;
+        *p++ = 'e';
+        if (scientific < 0) {
+            *p++ = '-';
+            scientific = -scientific;
         }
+        if (scientific >= 10) *p++ = (char)('0' + scientific / 10);
+        *p++ = (char)('0' + scientific % 10);
     }
 
-    fclose(file);
-    return matrix;
+    return (int)(p - out);
 }
 
-Matrix* readBiasesFromCSV(const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "Error opening file: %s\n", filename);
-        return NULL;
-    }
+// Buffered result output. Text and binary records are accumulated in one
+// large user-space buffer and handed to stdio in big chunks, so output order
+// with any printf on the same FILE is preserved.
+typedef enum {
+    OUTPUT_FINAL = 0,    // final outputs only
+    OUTPUT_LAYERS = 1,   // plus every intermediate conv and pool result
+    OUTPUT_ALL = 2       // plus the input, weights and progress messages
+} OutputVerbosity;
+
+typedef enum {
+    OUTPUT_TEXT = 0,
+    OUTPUT_BINARY = 1
+} OutputFormat;
+
+// Binary records: an OutputRecordHeader followed by rows * cols float32
+// values, row-major. Unused chain entries are -1.
+typedef enum {
+    RECORD_INPUT = 0,
+    RECORD_WEIGHTS = 1,
+    RECORD_BIASES = 2,
+    RECORD_CONV = 3,
+    RECORD_POOL = 4,
+    RECORD_FINAL = 5
+} OutputRecordKind;
+
+#define OUTPUT_RECORD_MAGIC 0x31525243u   // "CRR1"
+#define OUTPUT_MAX_CHAIN 8
 
-    int rows = 0;
-    char line[4096];
-    
-    while (fgets(line, sizeof(line), file)) {
-        rows++;
-    }
-    rewind(file);
+typedef struct {
+    uint32_t magic;
+    uint32_t kind;
+    int32_t layer;
+    int32_t chain[OUTPUT_MAX_CHAIN];
+    uint32_t rows;
+    uint32_t cols;
+    int64_t index;      // stream position for streamed outputs, else -1
+} OutputRecordHeader;
 
-    Matrix* matrix = createMatrix(rows, 1);  
-    for (int i = 0; i < rows; i++) {
-        if (!fgets(line, sizeof(line), file)) break;
-        matrix->data[i][0] = atof(line);  
+typedef struct {
+    FILE* file;
+    char* buffer;
+    size_t capacity;
+    size_t used;
+    int ownsBuffer;
+    OutputVerbosity verbosity;
+    OutputFormat format;
+} OutputWriter;
+
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
+// buffer may be NULL, in which case capacity bytes are allocated
+void initOutputWriter(OutputWriter* writer, FILE* file, char* buffer, size_t capacity,
+                      OutputVerbosity verbosity, OutputFormat format) {
+    initFloatFormatTables();
+    writer->file = file;
+    writer->capacity = capacity;
+    writer->used = 0;
+    writer->ownsBuffer = buffer == NULL;
+    writer->buffer = buffer ? buffer : (char*)malloc(capacity);
+    if (!writer->buffer) {
+        fprintf(stderr, "Memory allocation failed for output buffer\n");
+        exit(EXIT_FAILURE);
     }
+    writer->verbosity = verbosity;
+    writer->format = format;
+}
 
-    fclose(file);
-    return matrix;
+// Hands buffered bytes to the FILE; callers needing them on the fd now
+// (e.g. streaming) follow with fflush()
+void flushOutputWriter(OutputWriter* writer) {
+    if (writer->used > 0) {
+        uint64_t span = traceBegin();
+        fwrite(writer->buffer, 1, writer->used, writer->file);
+        writer->used = 0;
+        traceEnd("write output", -1, span);
+    }
 }
 
-float relu(float x) {
-    return x > 0 ? x : 0;
+void closeOutputWriter(OutputWriter* writer) {
+    flushOutputWriter(writer);
+    if (writer->ownsBuffer) free(writer->buffer);
+    writer->buffer = NULL;
 }
 
-float leakyRelu(float x) {
-    float alpha = 0.1;
-    return x > 0 ? x : alpha * x;
+// Makes room for at least bytes more, spilling the buffer if needed
+char* reserveOutput(OutputWriter* writer, size_t bytes) {
+    if (writer->used + bytes > writer->capacity) {
+        fwrite(writer->buffer, 1, writer->used, writer->file);
+        writer->used = 0;
+    }
+    return writer->buffer + writer->used;
 }
 
-float selu(float x, float alpha, float scale) {
-    return x > 0 ? scale * x : scale * alpha * (exp(x) - 1);
+void writeBytes(OutputWriter* writer, const void* data, size_t bytes) {
+    if (bytes > writer->capacity) {
+        flushOutputWriter(writer);
+        fwrite(data, 1, bytes, writer->file);
+        return;
+    }
+    memcpy(reserveOutput(writer, bytes), data, bytes);
+    writer->used += bytes;
 }
 
-float elu(float x, float alpha) {
-    return x > 0 ? x : alpha * (exp(x) - 1);
+int wantsOutput(const OutputWriter* writer, OutputVerbosity level) {
+    return writer->verbosity >= level;
 }
 
-Matrix* convolve(Matrix* input, Matrix* filter, Matrix* bias, int stride) {
-    int outputRows = ((input->rows - filter->rows) / stride) + 1;
-    int outputCols = ((input->cols - filter->cols) / stride) + 1;
+// Progress and label lines; dropped in binary mode or below level
+void writeText(OutputWriter* writer, OutputVerbosity level, const char* format, ...) {
+    if (writer->format != OUTPUT_TEXT || !wantsOutput(writer, level)) return;
+
+    char line[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (length < 0) return;
+    if (length >= (int)sizeof(line)) length = sizeof(line) - 1;
+    writeBytes(writer, line, length);
+}
 
-    if (outputRows <= 0 || outputCols <= 0) {
-        fprintf(stderr, "Invalid convolution dimensions\n");
-        return NULL;
+// Text form of values separated by separator, ending in terminator
+void writeFloatsText(OutputWriter* writer, const float* values, int count, char separator, const char* terminator) {
+    for (int i = 0; i < count; i++) {
+        char* p = reserveOutput(writer, FORMAT_FLOAT_MAX + 1);
+        int length = formatFloat(values[i], p);
+        p[length++] = separator;
+        writer->used += length;
     }
+    writeBytes(writer, terminator, strlen(terminator));
+}
 
-    Matrix* output = createMatrix(outputRows, outputCols);
-
-    for (int i = 0; i < outputRows; i++) {
-        for (int j = 0; j < outputCols; j++) {
-            float sum = 0;
-            for (int m = 0; m < filter->rows; m++) {
-                for (int n = 0; n < filter->cols; n++) {
-                    sum += input->data[i * stride + m][j * stride + n] * filter->data[m][n];
-                }
-            }
-            sum += bias->data[0][0];
-            sum = leakyRelu(sum);  
-            output->data[i][j] = sum;
-        }
+OutputVerbosity recordLevel(OutputRecordKind kind) {
+    switch (kind) {
+    case RECORD_FINAL:
+        return OUTPUT_FINAL;
+    case RECORD_CONV:
+    case RECORD_POOL:
+        return OUTPUT_LAYERS;
+    default:
+        return OUTPUT_ALL;
     }
-
-    return output;
 }
 
-Matrix* maxPool(Matrix* input, int poolRows, int poolCols, int stride) {
-    int outputRows = ((input->rows - poolRows) / stride) + 1;
-    int outputCols = ((input->cols - poolCols) / stride) + 1;
-
-    if (outputRows <= 0 || outputCols <= 0) {
-        fprintf(stderr, "Invalid pooling dimensions\n");
-        return NULL;
+void writeRecordHeader(OutputWriter* writer, OutputRecordKind kind, int layer, const int* chain, int depth,
+                       int rows, int cols, long index) {
+    OutputRecordHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = OUTPUT_RECORD_MAGIC;
+    header.kind = kind;
+    header.layer = layer;
+    for (int d = 0; d < OUTPUT_MAX_CHAIN; d++) {
+        header.chain[d] = d < depth ? chain[d] : -1;
     }
+    header.rows = rows;
+    header.cols = cols;
+    header.index = index;
+    writeBytes(writer, &header, sizeof(header));
+}
 
-    Matrix* output = createMatrix(outputRows, outputCols);
+// One row of results; text is space separated as printMatrix() always was
+void writeRow(OutputWriter* writer, OutputRecordKind kind, int layer, const int* chain, int depth,
+              const float* values, int count, long index) {
+    if (!wantsOutput(writer, recordLevel(kind))) return;
 
-    for (int i = 0; i < outputRows; i++) {
-        for (int j = 0; j < outputCols; j++) {
-            float maxVal = -INFINITY;
-            for (int m = 0; m < poolRows; m++) {
-                for (int n = 0; n < poolCols; n++) {
-                    int rowIndex = i * stride + m;
-                    int colIndex = j * stride + n;
-                    if (rowIndex < input->rows && colIndex < input->cols) {
-                        if (input->data[rowIndex][colIndex] > maxVal) {
-                            maxVal = input->data[rowIndex][colIndex];
-                        }
-                    }
-                }
-            }
-            output->data[i][j] = maxVal;
-        }
+    if (writer->format == OUTPUT_BINARY) {
+        writeRecordHeader(writer, kind, layer, chain, depth, 1, count, index);
+        writeBytes(writer, values, count * sizeof(float));
+    } else {
+        writeFloatsText(writer, values, count, ' ', "\n");
     }
-
-    return output;
 }
 
-void printMatrix(Matrix* matrix) {
+void writeMatrix(OutputWriter* writer, OutputRecordKind kind, int layer, const int* chain, int depth, const Matrix* matrix) {
+    if (!wantsOutput(writer, recordLevel(kind))) return;
+
     if (!matrix) {
-        printf("NULL matrix\n");
+        writeText(writer, recordLevel(kind), "NULL matrix\n");
         return;
     }
 
-    for (int i = 0; i < matrix->rows; i++) {
-        for (int j = 0; j < matrix->cols; j++) {
-            printf("%f ", matrix->data[i][j]);
+    if (writer->format == OUTPUT_BINARY) {
+        writeRecordHeader(writer, kind, layer, chain, depth, matrix->rows, matrix->cols, -1);
+        for (int i = 0; i < matrix->rows; i++) {
+            writeBytes(writer, matrix->data[i], matrix->cols * sizeof(float));
+        }
+    } else {
+        for (int i = 0; i < matrix->rows; i++) {
+            writeFloatsText(writer, matrix->data[i], matrix->cols, ' ', "\n");
         }
-        printf("\n");
     }
 }
 
+void printMatrix(Matrix* matrix) {
+    char buffer[16384];
+    OutputWriter writer;
+    initOutputWriter(&writer, stdout, buffer, sizeof(buffer), OUTPUT_ALL, OUTPUT_TEXT);
+    writeMatrix(&writer, RECORD_INPUT, 0, NULL, 0, matrix);
+    closeOutputWriter(&writer);
+}
+
 Matrix* secondLayerConvolutionAndPooling(Matrix* input, Matrix* filtersMatrix, Matrix* biasesMatrix, int stride, int poolRows, int poolCols, int poolStride) {
     int numFilters = filtersMatrix->rows;
     Matrix* finalResult = NULL;
@@ -377,178 +623,2228 @@ Matrix* thirdLayerConvolutionAndPooling(Matrix* input, Matrix* filtersMatrix, Ma
     return finalResult;
 }
 
-// ... [All previous functions remain the same until main()]
+// Reads a CSV with one signal per row in fixed-size batches of rows. Only a
+// fixed read buffer (grown at most to the longest row) and one batch buffer
+// are held, so memory stays constant regardless of file size.
+#define SIGNAL_READER_BUFFER (1 << 20)
 
-int main() {
-    const char* inputFile = "test.csv";
-    const char* filtersFile = "CNN_layer_1_filter_weights.csv";
-    const char* biasesFile = "CNN_layer_1_filter_bias.csv";  
-    const char* secondLayerFiltersFile = "CNN_layer_2_filter_weights.csv";
-    const char* secondLayerBiasesFile = "CNN_layer_2_filter_bias.csv";
-    const char* thirdLayerFiltersFile = "CNN_layer_3_filter_weights.csv";
-    const char* thirdLayerBiasesFile = "CNN_layer_3_filter_bias.csv";
-
-    Matrix* inputMatrix = readMatrixFromCSV(inputFile);
-    if (!inputMatrix) {
-        fprintf(stderr, "Failed to read input matrix\n");
-        return EXIT_FAILURE;
+typedef struct {
+    int fd;
+    char* buffer;
+    size_t capacity;
+    size_t start;      // first unparsed byte
+    size_t end;        // one past the last byte read
+    int eof;
+    int error;         // a read failed; the rest of the file is lost
+    int rowLength;     // values per row, fixed by the first row
+    int batchSize;
+    float* batch;      // batchSize rows of rowLength values
+    long rowsRead;
+} SignalReader;
+
+SignalReader* openSignalReader(const char* filename, int batchSize) {
+    int fd = strcmp(filename, "-") == 0 ? STDIN_FILENO : open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error opening file: %s\n", filename);
+        return NULL;
+    }
+
+    SignalReader* reader = (SignalReader*)calloc(1, sizeof(SignalReader));
+    if (!reader) {
+        fprintf(stderr, "Memory allocation failed for signal reader\n");
+        exit(EXIT_FAILURE);
     }
+    reader->fd = fd;
+    reader->capacity = SIGNAL_READER_BUFFER;
+    reader->buffer = (char*)malloc(reader->capacity);
+    if (!reader->buffer) {
+        fprintf(stderr, "Memory allocation failed for signal reader\n");
+        exit(EXIT_FAILURE);
+    }
+    reader->batchSize = batchSize;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return reader;
+}
 
-    printf("\nInput Matrix:\n");
-    printMatrix(inputMatrix);
+void closeSignalReader(SignalReader* reader) {
+    if (!reader) return;
+    if (reader->fd != STDIN_FILENO) close(reader->fd);
+    free(reader->buffer);
+    free(reader->batch);
+    free(reader);
+}
 
-    // Read all layer filters and biases
-    Matrix* filtersMatrix = readFiltersFromCSV(filtersFile);
-    Matrix* biasesMatrix = readBiasesFromCSV(biasesFile);
-    Matrix* secondLayerFiltersMatrix = readFiltersFromCSV(secondLayerFiltersFile);
-    Matrix* secondLayerBiasesMatrix = readBiasesFromCSV(secondLayerBiasesFile);
-    Matrix* thirdLayerFiltersMatrix = readFiltersFromCSV(thirdLayerFiltersFile);
-    Matrix* thirdLayerBiasesMatrix = readBiasesFromCSV(thirdLayerBiasesFile);
-
-    // Check all matrices were loaded successfully
-    if (!filtersMatrix || !biasesMatrix || !secondLayerFiltersMatrix || 
-        !secondLayerBiasesMatrix || !thirdLayerFiltersMatrix || !thirdLayerBiasesMatrix) {
-        fprintf(stderr, "Failed to read one or more filter or bias matrices\n");
-        if (inputMatrix) freeMatrix(inputMatrix);
-        if (filtersMatrix) freeMatrix(filtersMatrix);
-        if (biasesMatrix) freeMatrix(biasesMatrix);
-        if (secondLayerFiltersMatrix) freeMatrix(secondLayerFiltersMatrix);
-        if (secondLayerBiasesMatrix) freeMatrix(secondLayerBiasesMatrix);
-        if (thirdLayerFiltersMatrix) freeMatrix(thirdLayerFiltersMatrix);
-        if (thirdLayerBiasesMatrix) freeMatrix(thirdLayerBiasesMatrix);
-        return EXIT_FAILURE;
+// Makes [start, end) contain a whole line, reading more as needed. Returns the
+// line end (the newline or end of data), or NULL when the file is exhausted
+// or a read fails (reader->error is then set).
+const char* nextSignalLine(SignalReader* reader) {
+    for (;;) {
+        const char* data = reader->buffer + reader->start;
+        const char* newline = (const char*)memchr(data, '\n', reader->end - reader->start);
+        if (newline) return newline;
+        if (reader->eof) {
+            return reader->start < reader->end ? reader->buffer + reader->end : NULL;
+        }
+
+        // Keep the partial line and refill behind it
+        if (reader->start > 0) {
+            memmove(reader->buffer, data, reader->end - reader->start);
+            reader->end -= reader->start;
+            reader->start = 0;
+        }
+        if (reader->end == reader->capacity) {
+            reader->capacity *= 2;
+            reader->buffer = (char*)realloc(reader->buffer, reader->capacity);
+            if (!reader->buffer) {
+                fprintf(stderr, "Memory allocation failed for signal reader\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        ssize_t got = read(reader->fd, reader->buffer + reader->end, reader->capacity - reader->end);
+        if (got < 0) {
+            fprintf(stderr, "Error reading signal file: %s\n", strerror(errno));
+            reader->error = 1;
+            return NULL;
+        }
+        if (got == 0) reader->eof = 1;
+        reader->end += got;
     }
+}
 
-    // Print all matrices
-    printf("\nFilters Matrix (First Layer):\n");
-    printMatrix(filtersMatrix);
-    printf("\nBiases Matrix (First Layer):\n");
-    printMatrix(biasesMatrix);
-    printf("\nSecond Layer Filters Matrix:\n");
-    printMatrix(secondLayerFiltersMatrix);
-    printf("\nSecond Layer Biases Matrix:\n");
-    printMatrix(secondLayerBiasesMatrix);
-    printf("\nThird Layer Filters Matrix:\n");
-    printMatrix(thirdLayerFiltersMatrix);
-    printf("\nThird Layer Biases Matrix:\n");
-    printMatrix(thirdLayerBiasesMatrix);
+// Fills reader->batch with up to batchSize rows. Returns the number of rows
+// read, 0 at end of file, or -1 if a read fails or a row's length differs
+// from the first.
+int readSignalBatch(SignalReader* reader) {
+    uint64_t span = traceBegin();
+    int rows = 0;
 
-    // Configuration parameters
-    int stride = 2;
-    int filterRows = 1;
-    int filterCols = 10;
-    int numFilters = filtersMatrix->rows / filterRows;
-    int poolRows = 5;
-    int poolCols = 1;
-    int poolStride = 5;
+    while (rows < reader->batchSize) {
+        const char* lineEnd = nextSignalLine(reader);
+        if (!lineEnd && reader->error) return -1;
+        if (!lineEnd) break;
+
+        const char* p = reader->buffer + reader->start;
+        int count = 0;
+        float* row = reader->batch ? reader->batch + (size_t)rows * reader->rowLength : NULL;
+
+        // The first row is counted before the batch buffer exists
+        if (!reader->batch) {
+            for (const char* q = p; q < lineEnd;) {
+                while (q < lineEnd && isCSVDelimiter(*q)) q++;
+                if (q == lineEnd) break;
+                parseDecimal(q, lineEnd, &q);
+                count++;
+            }
+            if (count > 0) {
+                reader->rowLength = count;
+                reader->batch = (float*)malloc((size_t)reader->batchSize * count * sizeof(float));
+                if (!reader->batch) {
+                    fprintf(stderr, "Memory allocation failed for signal batch\n");
+                    exit(EXIT_FAILURE);
+                }
+                row = reader->batch;
+                count = 0;
+            }
+        }
+
+        while (p < lineEnd) {
+            while (p < lineEnd && isCSVDelimiter(*p)) p++;
+            if (p == lineEnd) break;
+            float value = parseDecimal(p, lineEnd, &p);
+            if (row && count < reader->rowLength) row[count] = value;
+            count++;
+        }
+
+        reader->start = lineEnd - reader->buffer;
+        if (reader->start < reader->end) reader->start++;
+
+        // Blank lines are skipped
+        if (count == 0) continue;
+
+        reader->rowsRead++;
+        if (count != reader->rowLength) {
+            fprintf(stderr, "Row %ld has %d values, expected %d\n", reader->rowsRead, count, reader->rowLength);
+            return -1;
+        }
+        rows++;
+    }
+
+    traceEnd("read batch", -1, span);
+    return rows;
+}
+
+// Fixed-size window over the most recent samples of a 1D stream. Samples are
+// written twice (at pos and pos + size) so the window is always contiguous.
+typedef struct {
+    float* buffer;
+    int size;
+    int pos;
+    int stride;
+    long count;
+} SampleRing;
+
+void initSampleRing(SampleRing* ring, int size, int stride) {
+    ring->buffer = (float*)calloc(2 * size, sizeof(float));
+    if (!ring->buffer) {
+        fprintf(stderr, "Memory allocation failed for stream window\n");
+        exit(EXIT_FAILURE);
+    }
+    ring->size = size;
+    ring->pos = 0;
+    ring->stride = stride;
+    ring->count = 0;
+}
+
+// Returns 1 when the window is full and aligned to the stride, i.e. when the
+// next output of the layer reading this ring is complete.
+int pushSample(SampleRing* ring, float value) {
+    ring->buffer[ring->pos] = value;
+    ring->buffer[ring->pos + ring->size] = value;
+    ring->pos = (ring->pos + 1) % ring->size;
+    ring->count++;
+    return ring->count >= ring->size && (ring->count - ring->size) % ring->stride == 0;
+}
+
+// Oldest sample first
+const float* ringWindow(const SampleRing* ring) {
+    return ring->buffer + ring->pos;
+}
+
+typedef void (*StreamOutputFn)(const int* chain, int depth, long index, float value, void* userData);
+
+// Streaming state of one layer: the tail of its input needed by the next conv
+// window, and a partially filled pool window per filter. Each filter feeds its
+// own stage of the next layer.
+typedef struct StreamStage {
+    const Layer* layer;
+    SampleRing input;
+    SampleRing* pools;
+    long* emitted;
+    struct StreamStage** next;
+} StreamStage;
+
+typedef struct {
+    const Model* model;
+    StreamStage* root;
+    StreamOutputFn output;
+    void* userData;
+} Stream;
+
+void freeStreamStage(StreamStage* stage) {
+    if (!stage) return;
+
+    for (int f = 0; f < stage->layer->filters->rows; f++) {
+        free(stage->pools[f].buffer);
+        freeStreamStage(stage->next[f]);
+    }
+    free(stage->input.buffer);
+    free(stage->pools);
+    free(stage->emitted);
+    free(stage->next);
+    free(stage);
+}
+
+StreamStage* createStreamStage(const Model* model, int layerIndex) {
+    const Layer* layer = &model->layers[layerIndex];
+    int numFilters = layer->filters->rows;
+
+    // Streams are a single row, so only pool windows that fit one row are valid
+    if (((1 - layer->poolRows) / layer->poolStride) + 1 != 1 || layer->filters->cols <= 0) {
+        fprintf(stderr, "Invalid streaming dimensions for layer %d\n", layerIndex + 1);
+        return NULL;
+    }
+
+    StreamStage* stage = (StreamStage*)malloc(sizeof(StreamStage));
+    if (!stage) {
+        fprintf(stderr, "Memory allocation failed for stream stage\n");
+        exit(EXIT_FAILURE);
+    }
+
+    stage->layer = layer;
+    initSampleRing(&stage->input, layer->filters->cols, layer->stride);
+    stage->pools = (SampleRing*)calloc(numFilters, sizeof(SampleRing));
+    stage->emitted = (long*)calloc(numFilters, sizeof(long));
+    stage->next = (StreamStage**)calloc(numFilters, sizeof(StreamStage*));
+    if (!stage->pools || !stage->emitted || !stage->next) {
+        fprintf(stderr, "Memory allocation failed for stream stage\n");
+        exit(EXIT_FAILURE);
+    }
 
-    // Process first layer
-    printf("\n=== Processing First Layer ===\n");
     for (int f = 0; f < numFilters; f++) {
-        // Create current filter for first layer
-        Matrix* currentFilter = createMatrix(filterRows, filterCols);
-        for (int i = 0; i < filterRows; i++) {
-            for (int j = 0; j < filterCols; j++) {
-                currentFilter->data[i][j] = filtersMatrix->data[f * filterRows + i][j];
+        initSampleRing(&stage->pools[f], layer->poolCols, layer->poolStride);
+        if (layerIndex + 1 < model->numLayers) {
+            stage->next[f] = createStreamStage(model, layerIndex + 1);
+            if (!stage->next[f]) {
+                freeStreamStage(stage);
+                return NULL;
             }
         }
+    }
 
-        // Create current bias for first layer
-        Matrix* currentBias = createMatrix(1, 1);
-        currentBias->data[0][0] = biasesMatrix->data[f][0];
+    return stage;
+}
 
-        // First layer convolution
-        printf("\nFirst Layer - Processing Filter %d:\n", f + 1);
-        Matrix* firstLayerResult = convolve(inputMatrix, currentFilter, currentBias, stride);
-        if (firstLayerResult) {
-            printf("First Layer Convolution Output:\n");
-            printMatrix(firstLayerResult);
+Stream* createStream(const Model* model, StreamOutputFn output, void* userData) {
+    Stream* stream = (Stream*)malloc(sizeof(Stream));
+    if (!stream) {
+        fprintf(stderr, "Memory allocation failed for stream\n");
+        exit(EXIT_FAILURE);
+    }
 
-            // First layer pooling
-            Matrix* firstLayerPooled = maxPool(firstLayerResult, poolRows, poolCols, poolStride);
-            if (firstLayerPooled) {
-                printf("First Layer Pooling Output:\n");
-                printMatrix(firstLayerPooled);
+    stream->model = model;
+    stream->output = output;
+    stream->userData = userData;
+    stream->root = createStreamStage(model, 0);
+    if (!stream->root) {
+        free(stream);
+        return NULL;
+    }
+    return stream;
+}
 
-                // Second layer processing
-                int numSecondLayerFilters = secondLayerFiltersMatrix->rows;
-                for (int sf = 0; sf < numSecondLayerFilters; sf++) {
-                    // Create second layer filter and bias
-                    Matrix* secondFilter = createMatrix(1, secondLayerFiltersMatrix->cols);
-                    for (int j = 0; j < secondLayerFiltersMatrix->cols; j++) {
-                        secondFilter->data[0][j] = secondLayerFiltersMatrix->data[sf][j];
-                    }
-                    
-                    Matrix* secondBias = createMatrix(1, 1);
-                    secondBias->data[0][0] = secondLayerBiasesMatrix->data[sf][0];
+void freeStream(Stream* stream) {
+    if (!stream) return;
+    freeStreamStage(stream->root);
+    free(stream);
+}
 
-                    // Second layer convolution
-                    printf("\nSecond Layer - Processing Filter Chain %d-%d:\n", f + 1, sf + 1);
-                    Matrix* secondLayerResult = convolve(firstLayerPooled, secondFilter, secondBias, stride);
-                    if (secondLayerResult) {
-                        printf("Second Layer Convolution Output:\n");
-                        printMatrix(secondLayerResult);
+// Feeds one sample into a stage and pushes every output whose receptive field
+// is now complete further down the chain. Summation order matches convolve()
+// and maxPool() so streamed outputs are identical to the whole-window run.
+void streamStagePush(Stream* stream, StreamStage* stage, int depth, int* chain, float value) {
+    if (!pushSample(&stage->input, value)) return;
 
-                        // Second layer pooling
-                        Matrix* secondLayerPooled = maxPool(secondLayerResult, poolRows, poolCols, poolStride);
-                        if (secondLayerPooled) {
-                            printf("Second Layer Pooling Output:\n");
-                            printMatrix(secondLayerPooled);
+    const Layer* layer = stage->layer;
+    const float* window = ringWindow(&stage->input);
 
-                            // Third layer processing
-                            int numThirdLayerFilters = thirdLayerFiltersMatrix->rows;
-                            for (int tf = 0; tf < numThirdLayerFilters; tf++) {
-                                // Create third layer filter and bias
-                                Matrix* thirdFilter = createMatrix(1, thirdLayerFiltersMatrix->cols);
-                                for (int j = 0; j < thirdLayerFiltersMatrix->cols; j++) {
-                                    thirdFilter->data[0][j] = thirdLayerFiltersMatrix->data[tf][j];
-                                }
-                                
-                                Matrix* thirdBias = createMatrix(1, 1);
-                                thirdBias->data[0][0] = thirdLayerBiasesMatrix->data[tf][0];
+    for (int f = 0; f < layer->filters->rows; f++) {
+        float sum = 0;
+        for (int n = 0; n < layer->filters->cols; n++) {
+            sum += window[n] * layer->filters->data[f][n];
+        }
+        sum += layer->biases->data[f][0];
+        sum = applyActivation(layer, sum);
 
-                                // Third layer convolution
-                                printf("\nThird Layer - Processing Filter Chain %d-%d-%d:\n", f + 1, sf + 1, tf + 1);
-                                Matrix* thirdLayerResult = convolve(secondLayerPooled, thirdFilter, thirdBias, stride);
-                                if (thirdLayerResult) {
-                                    printf("Third Layer Convolution Output:\n");
-                                    printMatrix(thirdLayerResult);
+        if (!pushSample(&stage->pools[f], sum)) continue;
 
-                                    // Third layer pooling
-                                    Matrix* thirdLayerPooled = maxPool(thirdLayerResult, poolRows, poolCols, poolStride);
-                                    if (thirdLayerPooled) {
-                                        printf("Third Layer Final Output (Filter Chain %d-%d-%d):\n", f + 1, sf + 1, tf + 1);
-                                        printMatrix(thirdLayerPooled);
-                                        freeMatrix(thirdLayerPooled);
-                                    }
-                                    freeMatrix(thirdLayerResult);
-                                }
-                                freeMatrix(thirdFilter);
-                                freeMatrix(thirdBias);
-                            }
-                            freeMatrix(secondLayerPooled);
-                        }
-                        freeMatrix(secondLayerResult);
-                    }
-                    freeMatrix(secondFilter);
-                    freeMatrix(secondBias);
-                }
-                freeMatrix(firstLayerPooled);
+        const float* poolWindow = ringWindow(&stage->pools[f]);
+        float maxVal = -INFINITY;
+        for (int n = 0; n < stage->pools[f].size; n++) {
+            if (poolWindow[n] > maxVal) {
+                maxVal = poolWindow[n];
             }
-            freeMatrix(firstLayerResult);
         }
-        freeMatrix(currentFilter);
-        freeMatrix(currentBias);
+
+        chain[depth] = f;
+        if (stage->next[f]) {
+            streamStagePush(stream, stage->next[f], depth + 1, chain, maxVal);
+        } else {
+            stream->output(chain, depth + 1, stage->emitted[f], maxVal, stream->userData);
+        }
+        stage->emitted[f]++;
+    }
+}
+
+void streamPush(Stream* stream, const float* samples, int count) {
+    int chain[MAX_LAYERS];
+    for (int i = 0; i < count; i++) {
+        streamStagePush(stream, stream->root, 0, chain, samples[i]);
+    }
+}
+
+// userData is the OutputWriter
+void writeStreamOutput(const int* chain, int depth, long index, float value, void* userData) {
+    OutputWriter* writer = (OutputWriter*)userData;
+
+    if (writer->format == OUTPUT_BINARY) {
+        writeRow(writer, RECORD_FINAL, depth - 1, chain, depth, &value, 1, index);
+        return;
     }
 
+    char* p = reserveOutput(writer, 32 + depth * 12 + FORMAT_FLOAT_MAX);
+    p += sprintf(p, "Filter Chain ");
+    for (int d = 0; d < depth; d++) {
+        p += sprintf(p, d == 0 ? "%d" : "-%d", chain[d] + 1);
+    }
+    p += sprintf(p, " [%ld]: ", index);
+    p += formatFloat(value, p);
+    *p++ = '\n';
+    writer->used = p - writer->buffer;
+}
+
+// Reads the next comma/whitespace separated value, so arbitrarily long lines
+// and values split across reads are handled. Values go through parseDecimal()
+// like the CSV readers, so both round the same way. Returns 0 at end of
+// input and -1 for a token too long to be a sample.
+int readNextSample(FILE* file, float* value) {
+    char token[64];
+    int length = 0;
+    int c;
+
+    while ((c = fgetc(file)) != EOF) {
+        if (c == ',' || c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+            if (length > 0) break;
+            continue;
+        }
+        if (length == (int)sizeof(token) - 1) {
+            token[length] = '\0';
+            fprintf(stderr, "Sample too long: %s...\n", token);
+            return -1;
+        }
+        token[length++] = (char)c;
+    }
+
+    if (length == 0) return 0;
+    const char* end;
+    *value = parseDecimal(token, token + length, &end);
+    return 1;
+}
+
+int runStreaming(const Model* model, FILE* source, OutputWriter* writer) {
+    Stream* stream = createStream(model, writeStreamOutput, writer);
+    if (!stream) {
+        fprintf(stderr, "Failed to create stream\n");
+        return EXIT_FAILURE;
+    }
+
+    // Outputs are emitted as soon as they are complete, so everything a
+    // sample produced is written out before reading the next one
+    float sample;
+    int status;
+    while ((status = readNextSample(source, &sample)) > 0) {
+        streamPush(stream, &sample, 1);
+        if (writer->used > 0) {
+            flushOutputWriter(writer);
+            fflush(writer->file);
+        }
+    }
+
+    freeStream(stream);
+    return status < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Touches every page of a buffer so the first inference does not fault
+void prefaultBuffer(void* buffer, size_t bytes) {
+    volatile char* bytesPtr = (volatile char*)buffer;
+    long pageSize = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < bytes; i += pageSize) {
+        bytesPtr[i] = bytesPtr[i];
+    }
+    if (bytes > 0) {
+        bytesPtr[bytes - 1] = bytesPtr[bytes - 1];
+    }
+}
+
+void prefaultStack(void) {
+    volatile char stack[256 * 1024];
+    for (size_t i = 0; i < sizeof(stack); i += 4096) {
+        stack[i] = 0;
+    }
+}
+
+long long nowNanoseconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int compareLongLong(const void* a, const void* b) {
+    long long x = *(const long long*)a;
+    long long y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+// Prints a power-of-two bucketed histogram and tail percentiles of the
+// recorded per-inference latencies. Sorts samples in place.
+void printLatencyHistogram(long long* samples, long count) {
+    if (count <= 0) return;
+
+    long buckets[64] = {0};
+    for (long i = 0; i < count; i++) {
+        int b = 0;
+        while (b < 63 && (1LL << (b + 1)) <= samples[i]) b++;
+        buckets[b]++;
+    }
+
+    qsort(samples, count, sizeof(long long), compareLongLong);
+
+    printf("Inferences: %ld\n", count);
+    printf("min %lld ns, p50 %lld ns, p99 %lld ns, p99.9 %lld ns, max %lld ns\n",
+           samples[0], samples[count / 2], samples[(long)(count * 0.99)],
+           samples[(long)(count * 0.999)], samples[count - 1]);
+
+    long peak = 0;
+    for (int b = 0; b < 64; b++) {
+        if (buckets[b] > peak) peak = buckets[b];
+    }
+
+    printf("\nLatency histogram (ns):\n");
+    for (int b = 0; b < 64; b++) {
+        if (!buckets[b]) continue;
+        int width = (int)((buckets[b] * 50) / peak);
+        printf("[%10lld, %10lld) %9ld |", 1LL << b, 1LL << (b + 1), buckets[b]);
+        for (int i = 0; i < width; i++) putchar('#');
+        putchar('\n');
+    }
+}
+
+// Single-signal low-latency mode: every buffer is allocated, locked and
+// pre-faulted up front, the thread is optionally pinned to one core, and the
+// timed loop makes no allocation, I/O or syscalls (the clock is vDSO).
+// countLayers adds per-layer counter reads, which are syscalls, to the loop.
+int runRealtime(const Model* model, const Matrix* input, long iterations, int cpu, const char* latencyFile,
+                int countLayers) {
+    Workspace* ws = createWorkspace(model, input->cols);
+    if (!ws) return EXIT_FAILURE;
+    if (countLayers) ws->counters = openLayerCounters();
+
+    float* output = (float*)calloc((size_t)ws->numChains * ws->outputLength, sizeof(float));
+    long long* samples = (long long*)calloc(iterations, sizeof(long long));
+    if (!output || !samples) {
+        fprintf(stderr, "Memory allocation failed for realtime buffers\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+            fprintf(stderr, "Warning: could not pin to CPU %d\n", cpu);
+        }
+    }
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        fprintf(stderr, "Warning: mlockall failed, pages may be swapped or faulted\n");
+    }
+
+    for (int l = 0; l < model->numLayers; l++) {
+        size_t numFilters = model->layers[l].filters->rows;
+        prefaultBuffer(ws->conv[l], numFilters * ws->convLength[l] * sizeof(float));
+        prefaultBuffer(ws->pooled[l], numFilters * ws->poolLength[l] * sizeof(float));
+    }
+    prefaultBuffer(output, (size_t)ws->numChains * ws->outputLength * sizeof(float));
+    prefaultBuffer(samples, iterations * sizeof(long long));
+    prefaultStack();
+
+    // Warm caches and branch predictors before measuring
+    for (int i = 0; i < 100; i++) {
+        inferWorkspace(model, ws, input->data[0], output);
+    }
+
+    for (long i = 0; i < iterations; i++) {
+        long long start = nowNanoseconds();
+        inferWorkspace(model, ws, input->data[0], output);
+        samples[i] = nowNanoseconds() - start;
+    }
+
+    if (latencyFile) {
+        FILE* file = fopen(latencyFile, "w");
+        if (!file) {
+            fprintf(stderr, "Error opening file: %s\n", latencyFile);
+        } else {
+            for (long i = 0; i < iterations; i++) {
+                fprintf(file, "%lld\n", samples[i]);
+            }
+            fclose(file);
+        }
+    }
+
+    printLatencyHistogram(samples, iterations);
+    if (ws->counters) printLayerCounters(ws->counters, model, stderr);
+
+    munlockall();
+    free(samples);
+    free(output);
+    closeLayerCounters(ws->counters);
+    freeWorkspace(ws, model);
+    return EXIT_SUCCESS;
+}
+
+// Times each layer's conv and pool over repeated inferences of input and
+// prints them against the analytic work and measured machine peaks
+int runRoofline(const Model* model, const Matrix* input, long iterations) {
+    Workspace* ws = createWorkspace(model, input->cols);
+    if (!ws) return EXIT_FAILURE;
+    float* output = (float*)malloc((size_t)ws->numChains * ws->outputLength * sizeof(float));
+    LayerProfile* profile = (LayerProfile*)calloc(1, sizeof(LayerProfile));
+    if (!output || !profile) {
+        fprintf(stderr, "Memory allocation failed for roofline buffers\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Warm caches and branch predictors before profiling
+    for (long i = 0; i < iterations / 10 + 1; i++) inferWorkspace(model, ws, input->data[0], output);
+    ws->profile = profile;
+    for (long i = 0; i < iterations; i++) inferWorkspace(model, ws, input->data[0], output);
+    ws->profile = NULL;
+
+    MachinePeaks peaks;
+    measureMachinePeaks(&peaks);
+    printRoofline(model, ws, profile, &peaks, stdout);
+
+    free(profile);
+    free(output);
+    freeWorkspace(ws, model);
+    return EXIT_SUCCESS;
+}
+
+// Times depth-first tiled inference against the row-at-a-time workspace on
+// one signal, checks the outputs match exactly and prints the intermediate
+// traffic of both. A signalLength above 0 replaces the input with a synthetic
+// signal of that length; tileLength 0 picks the largest tile whose layers fit
+// in half the L1 data cache.
+int runDepthFirst(const Model* model, const Matrix* input, int tileLength, long iterations, int signalLength) {
+    const float* signal = input->data[0];
+    float* synthetic = NULL;
+    if (signalLength > 0) {
+        synthetic = (float*)malloc((size_t)signalLength * sizeof(float));
+        if (!synthetic) {
+            fprintf(stderr, "Memory allocation failed for synthetic signal\n");
+            exit(EXIT_FAILURE);
+        }
+        generateSignal(synthetic, signalLength, 1, 0);
+        signal = synthetic;
+    } else {
+        signalLength = input->cols;
+    }
+
+    Workspace* ws = createWorkspace(model, signalLength);
+    if (!ws) {
+        free(synthetic);
+        return EXIT_FAILURE;
+    }
+
+    long l1Bytes = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+    if (l1Bytes <= 0) l1Bytes = 32 * 1024;
+    if (tileLength <= 0) tileLength = chooseTileLength(model, ws, l1Bytes / 2);
+    TileWorkspace* tw = createTileWorkspace(model, ws, tileLength);
+
+    size_t outputCount = (size_t)ws->numChains * ws->outputLength;
+    float* expected = (float*)malloc(outputCount * sizeof(float));
+    float* output = (float*)malloc(outputCount * sizeof(float));
+    if (!expected || !output) {
+        fprintf(stderr, "Memory allocation failed for depth-first buffers\n");
+        exit(EXIT_FAILURE);
+    }
+
+    inferWorkspace(model, ws, signal, expected);
+    inferTiled(model, ws, tw, signal, output);
+    int status = EXIT_SUCCESS;
+    if (memcmp(expected, output, outputCount * sizeof(float)) != 0) {
+        fprintf(stderr, "Depth-first outputs differ from the row-at-a-time outputs\n");
+        status = EXIT_FAILURE;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < iterations; i++) inferWorkspace(model, ws, signal, output);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double rowMicros = ((end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3) / iterations;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < iterations; i++) inferTiled(model, ws, tw, signal, output);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double tiledMicros = ((end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3) / iterations;
+
+    printf("signal length %d, %d outputs per chain\n", signalLength, ws->outputLength);
+    printTileTraffic(model, ws, tw, l1Bytes, stdout);
+    printf("row at a time: %.1f us per inference\n", rowMicros);
+    printf("depth-first:   %.1f us per inference (%.2fx)\n", tiledMicros, rowMicros / tiledMicros);
+
+    free(output);
+    free(expected);
+    freeTileWorkspace(tw, model);
+    freeWorkspace(ws, model);
+    free(synthetic);
+    return status;
+}
+
+// Streams a one-signal-per-row CSV through the batch inference path and
+// prints one line of final outputs per signal
+// dumpDir, when set, receives the selected activations of every signal;
+// countLayers prints per-layer performance counters to stderr at the end
+int runBatchFile(const Model* model, const char* filename, int batchSize, OutputWriter* writer,
+                 const char* dumpDir, const char* dumpSelection, int countLayers) {
+    SignalReader* reader = openSignalReader(filename, batchSize);
+    if (!reader) return EXIT_FAILURE;
+
+    Workspace* ws = NULL;
+    float* outputs = NULL;
+    size_t outputStride = 0;
+    int status = EXIT_SUCCESS;
+    int rows;
+
+    while ((rows = readSignalBatch(reader)) > 0) {
+        if (!ws) {
+            ws = createWorkspace(model, reader->rowLength);
+            if (!ws) {
+                status = EXIT_FAILURE;
+                break;
+            }
+            if (countLayers) ws->counters = openLayerCounters();
+            outputStride = (size_t)ws->numChains * ws->outputLength;
+            outputs = (float*)malloc(batchSize * outputStride * sizeof(float));
+            if (!outputs) {
+                fprintf(stderr, "Memory allocation failed for batch outputs\n");
+                exit(EXIT_FAILURE);
+            }
+            if (dumpDir) {
+                ws->dump = createActivationDump(dumpDir, dumpSelection, model, ws, 1);
+                if (!ws->dump) {
+                    status = EXIT_FAILURE;
+                    break;
+                }
+            }
+        }
+
+        if (ws->dump && !reserveActivationDump(ws->dump, rows)) {
+            status = EXIT_FAILURE;
+            break;
+        }
+        inferBatch(model, ws, reader->batch, rows, outputs);
+
+        long firstRow = reader->rowsRead - rows;
+        for (int i = 0; i < rows; i++) {
+            const float* output = outputs + i * outputStride;
+            if (writer->format == OUTPUT_BINARY) {
+                writeRow(writer, RECORD_FINAL, model->numLayers - 1, NULL, 0, output, outputStride, firstRow + i);
+            } else if (outputStride > 0) {
+                writeFloatsText(writer, output, outputStride - 1, ',', "");
+                writeFloatsText(writer, output + outputStride - 1, 1, '\n', "");
+            }
+        }
+    }
+    if (rows < 0) status = EXIT_FAILURE;
+
+    if (ws) {
+        closeActivationDump(ws->dump);
+        if (ws->counters) printLayerCounters(ws->counters, model, stderr);
+        closeLayerCounters(ws->counters);
+    }
+    free(outputs);
+    freeWorkspace(ws, model);
+    closeSignalReader(reader);
+    return status;
+}
+
+// Binary frame protocol for --frames. Every frame is a header followed by
+// native little-endian float32 values, so no text is parsed on either side:
+//
+//   request:  SignalFrameHeader, float samples[samples]
+//   response: ResultFrameHeader, float values[chains][length]
+//
+// Responses come back in request order, one per request. A request whose
+// length the model cannot take gets FRAME_STATUS_BAD_LENGTH and no values;
+// a bad magic or a truncated frame ends the session since the stream cannot
+// be resynchronized.
+#define SIGNAL_FRAME_MAGIC 0x31464e43u   // "CNF1"
+#define RESULT_FRAME_MAGIC 0x31524e43u   // "CNR1"
+#define FRAME_MAX_SAMPLES (1 << 24)
+#define FRAME_STATUS_OK 0
+#define FRAME_STATUS_BAD_LENGTH 1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t samples;
+} SignalFrameHeader;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t status;
+    uint32_t chains;
+    uint32_t length;
+} ResultFrameHeader;
+
+typedef struct {
+    int fd;
+    char* buffer;
+    size_t capacity;
+    size_t start;
+    size_t end;
+} FrameReader;
+
+// Makes at least need bytes available at reader->buffer + reader->start.
+// Pending output is flushed before any read that may block, so a client that
+// waits for its answer before sending more never deadlocks. Returns 0 at end
+// of input.
+int fillFrameReader(FrameReader* reader, size_t need, OutputWriter* pending) {
+    while (reader->end - reader->start < need) {
+        if (reader->start > 0) {
+            memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+            reader->end -= reader->start;
+            reader->start = 0;
+        }
+        while (reader->capacity < need) {
+            reader->capacity *= 2;
+            reader->buffer = (char*)realloc(reader->buffer, reader->capacity);
+            if (!reader->buffer) {
+                fprintf(stderr, "Memory allocation failed for frame buffer\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        if (pending) {
+            flushOutputWriter(pending);
+            fflush(pending->file);
+        }
+        ssize_t got = read(reader->fd, reader->buffer + reader->end, reader->capacity - reader->end);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return 0;
+        reader->end += got;
+    }
+    return 1;
+}
+
+// Serves signal frames from stdin until end of input, keeping one workspace
+// for the most recent signal length
+int runFrames(const Model* model, OutputWriter* writer) {
+    FrameReader reader = {STDIN_FILENO, NULL, SIGNAL_READER_BUFFER, 0, 0};
+    reader.buffer = (char*)malloc(reader.capacity);
+    if (!reader.buffer) {
+        fprintf(stderr, "Memory allocation failed for frame buffer\n");
+        exit(EXIT_FAILURE);
+    }
+
+    Workspace* ws = NULL;
+    float* output = NULL;
+    int badLength = -1;
+    int status = EXIT_SUCCESS;
+
+    while (fillFrameReader(&reader, sizeof(SignalFrameHeader), writer)) {
+        SignalFrameHeader header;
+        memcpy(&header, reader.buffer + reader.start, sizeof(header));
+        if (header.magic != SIGNAL_FRAME_MAGIC || header.samples > FRAME_MAX_SAMPLES) {
+            fprintf(stderr, "Invalid signal frame header\n");
+            status = EXIT_FAILURE;
+            break;
+        }
+
+        size_t frameBytes = sizeof(header) + (size_t)header.samples * sizeof(float);
+        if (!fillFrameReader(&reader, frameBytes, writer)) {
+            fprintf(stderr, "Truncated signal frame\n");
+            status = EXIT_FAILURE;
+            break;
+        }
+        const float* samples = (const float*)(reader.buffer + reader.start + sizeof(header));
+
+        // Rebuild the workspace only when the length changes; a length that
+        // already failed is rejected without reporting it again
+        if ((!ws || ws->inputLength != (int)header.samples) && badLength != (int)header.samples) {
+            freeWorkspace(ws, model);
+            free(output);
+            output = NULL;
+            ws = createWorkspace(model, header.samples);
+            if (ws) {
+                output = (float*)malloc((size_t)ws->numChains * ws->outputLength * sizeof(float));
+                if (!output) {
+                    fprintf(stderr, "Memory allocation failed for frame output\n");
+                    exit(EXIT_FAILURE);
+                }
+            } else {
+                badLength = header.samples;
+            }
+        }
+
+        ResultFrameHeader result = {RESULT_FRAME_MAGIC, FRAME_STATUS_BAD_LENGTH, 0, 0};
+        if (ws && ws->inputLength == (int)header.samples) {
+            inferWorkspace(model, ws, samples, output);
+            result.status = FRAME_STATUS_OK;
+            result.chains = ws->numChains;
+            result.length = ws->outputLength;
+        }
+        writeBytes(writer, &result, sizeof(result));
+        if (result.status == FRAME_STATUS_OK) {
+            writeBytes(writer, output, (size_t)result.chains * result.length * sizeof(float));
+        }
+        reader.start += frameBytes;
+    }
+
+    if (status == EXIT_SUCCESS && reader.start != reader.end) {
+        fprintf(stderr, "Truncated signal frame\n");
+        status = EXIT_FAILURE;
+    }
+
+    flushOutputWriter(writer);
+    fflush(writer->file);
+    free(output);
+    freeWorkspace(ws, model);
+    free(reader.buffer);
+    return status;
+}
+
+// Inference daemon for --daemon. Clients connect to a Unix domain socket and
+// speak the --frames protocol; requests from all connections are queued and
+// run in batches of up to maxBatch signals of the same length, a batch
+// starting once it is full or its oldest request has waited maxWaitMicros.
+// One thread multiplexes every connection with ppoll(), so the model and the
+// workspace are only ever touched by the batch loop.
+#define DAEMON_MAX_CLIENTS 256
+#define DAEMON_MAX_QUEUE 4096
+#define DAEMON_OUTPUT_LIMIT (4 << 20)   // stop reading a client that does not drain its replies
+#define DAEMON_MAX_SAMPLES (1 << 20)    // latency samples kept for the shutdown report
+
+typedef struct {
+    int fd;
+    char* input;
+    size_t inputCapacity;
+    size_t inputUsed;
+    char* output;
+    size_t outputCapacity;
+    size_t outputUsed;
+    size_t outputSent;
+    int finished;      // sent end of input; closed once its replies are out
+} DaemonClient;
+
+typedef struct {
+    int client;
+    int samples;
+    long long arrived;
+    float* data;
+} DaemonRequest;
+
+typedef struct {
+    long long* values;
+    long count;
+} LatencySamples;
+
+volatile sig_atomic_t daemonStopping = 0;
+
+void stopDaemon(int signal) {
+    (void)signal;
+    daemonStopping = 1;
+}
+
+void recordLatency(LatencySamples* samples, long long value) {
+    if (samples->count < DAEMON_MAX_SAMPLES) {
+        samples->values[samples->count++] = value;
+    }
+}
+
+// One-line summary in microseconds; sorts samples in place
+void printLatencySummary(const char* label, LatencySamples* samples) {
+    if (samples->count <= 0) return;
+    long long* v = samples->values;
+    long n = samples->count;
+    qsort(v, n, sizeof(long long), compareLongLong);
+    printf("%-8s p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n", label,
+           v[n / 2] / 1e3, v[(long)(n * 0.99)] / 1e3, v[(long)(n * 0.999)] / 1e3, v[n - 1] / 1e3);
+}
+
+void queueClientOutput(DaemonClient* client, const void* data, size_t bytes) {
+    if (client->outputUsed + bytes > client->outputCapacity) {
+        while (client->outputUsed + bytes > client->outputCapacity) {
+            client->outputCapacity = client->outputCapacity ? client->outputCapacity * 2 : 65536;
+        }
+        client->output = (char*)realloc(client->output, client->outputCapacity);
+        if (!client->output) {
+            fprintf(stderr, "Memory allocation failed for client output\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    memcpy(client->output + client->outputUsed, data, bytes);
+    client->outputUsed += bytes;
+}
+
+// Sends what the socket takes without blocking. Returns 0 if the client is gone.
+int sendClientOutput(DaemonClient* client) {
+    while (client->outputSent < client->outputUsed) {
+        ssize_t sent = send(client->fd, client->output + client->outputSent,
+                            client->outputUsed - client->outputSent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 1;
+        if (sent <= 0) return 0;
+        client->outputSent += sent;
+    }
+    client->outputUsed = client->outputSent = 0;
+    return 1;
+}
+
+void closeDaemonClient(DaemonClient* clients, int index, DaemonRequest* queue, int* queued) {
+    // Requests of a vanished client are dropped rather than computed
+    int kept = 0;
+    for (int i = 0; i < *queued; i++) {
+        if (queue[i].client == index) {
+            free(queue[i].data);
+        } else {
+            queue[kept++] = queue[i];
+        }
+    }
+    *queued = kept;
+
+    close(clients[index].fd);
+    free(clients[index].input);
+    free(clients[index].output);
+    memset(&clients[index], 0, sizeof(DaemonClient));
+    clients[index].fd = -1;
+}
+
+// Queues every complete frame buffered for a client, as far as the queue has
+// room. Returns 0 if the client broke the protocol.
+int parseDaemonClient(DaemonClient* clients, int index, DaemonRequest* queue, int* queued) {
+    DaemonClient* client = &clients[index];
+    size_t start = 0;
+    long long now = nowNanoseconds();
+    while (client->inputUsed - start >= sizeof(SignalFrameHeader)) {
+        SignalFrameHeader header;
+        memcpy(&header, client->input + start, sizeof(header));
+        if (header.magic != SIGNAL_FRAME_MAGIC || header.samples > FRAME_MAX_SAMPLES) {
+            fprintf(stderr, "Invalid signal frame header from client %d\n", index);
+            return 0;
+        }
+
+        size_t frameBytes = sizeof(header) + (size_t)header.samples * sizeof(float);
+        if (client->inputUsed - start < frameBytes) {
+            // Make room for the rest of a large frame
+            while (client->inputCapacity < frameBytes) client->inputCapacity *= 2;
+            client->input = (char*)realloc(client->input, client->inputCapacity);
+            if (!client->input) {
+                fprintf(stderr, "Memory allocation failed for client input\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        }
+        if (*queued == DAEMON_MAX_QUEUE) break;
+
+        DaemonRequest* request = &queue[(*queued)++];
+        request->client = index;
+        request->samples = header.samples;
+        request->arrived = now;
+        request->data = (float*)malloc((header.samples ? header.samples : 1) * sizeof(float));
+        if (!request->data) {
+            fprintf(stderr, "Memory allocation failed for request\n");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(request->data, client->input + start + sizeof(header), (size_t)header.samples * sizeof(float));
+        start += frameBytes;
+    }
+
+    memmove(client->input, client->input + start, client->inputUsed - start);
+    client->inputUsed -= start;
+    return 1;
+}
+
+// Reads what is available and queues the complete frames. Returns 0 if the
+// client is gone or broke the protocol.
+int readDaemonClient(DaemonClient* clients, int index, DaemonRequest* queue, int* queued) {
+    DaemonClient* client = &clients[index];
+    if (client->inputUsed == client->inputCapacity) {
+        client->inputCapacity = client->inputCapacity ? client->inputCapacity * 2 : 65536;
+        client->input = (char*)realloc(client->input, client->inputCapacity);
+        if (!client->input) {
+            fprintf(stderr, "Memory allocation failed for client input\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    ssize_t got = recv(client->fd, client->input + client->inputUsed, client->inputCapacity - client->inputUsed, MSG_DONTWAIT);
+    if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return 1;
+    if (got < 0) return 0;
+    if (got == 0) {
+        // A trailing partial frame can never complete
+        client->finished = 1;
+        if (!parseDaemonClient(clients, index, queue, queued)) return 0;
+        return client->inputUsed == 0 || *queued == DAEMON_MAX_QUEUE;
+    }
+    client->inputUsed += got;
+    return parseDaemonClient(clients, index, queue, queued);
+}
+
+int runDaemon(const Model* model, const char* socketPath, int maxBatch, long maxWaitMicros) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socketPath);
+        return EXIT_FAILURE;
+    }
+    strcpy(address.sun_path, socketPath);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socketPath);
+    if (listener < 0 || bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 64) != 0) {
+        fprintf(stderr, "Error listening on %s: %s\n", socketPath, strerror(errno));
+        if (listener >= 0) close(listener);
+        return EXIT_FAILURE;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopDaemon;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    DaemonClient* clients = (DaemonClient*)calloc(DAEMON_MAX_CLIENTS, sizeof(DaemonClient));
+    DaemonRequest* queue = (DaemonRequest*)malloc(DAEMON_MAX_QUEUE * sizeof(DaemonRequest));
+    DaemonRequest* batch = (DaemonRequest*)malloc(maxBatch * sizeof(DaemonRequest));
+    struct pollfd* polls = (struct pollfd*)malloc((DAEMON_MAX_CLIENTS + 1) * sizeof(struct pollfd));
+    int* pollClient = (int*)malloc((DAEMON_MAX_CLIENTS + 1) * sizeof(int));
+    LatencySamples queueTimes = {(long long*)malloc(DAEMON_MAX_SAMPLES * sizeof(long long)), 0};
+    LatencySamples computeTimes = {(long long*)malloc(DAEMON_MAX_SAMPLES * sizeof(long long)), 0};
+    if (!clients || !queue || !batch || !polls || !pollClient || !queueTimes.values || !computeTimes.values) {
+        fprintf(stderr, "Memory allocation failed for daemon\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < DAEMON_MAX_CLIENTS; i++) clients[i].fd = -1;
+
+    Workspace* ws = NULL;
+    float* inputs = NULL;
+    float* outputs = NULL;
+    int badLength = -1;
+    int queued = 0;
+    long batches = 0;
+    long requests = 0;
+    long rejected = 0;
+
+    printf("Listening on %s (max batch %d, max wait %ld us)\n", socketPath, maxBatch, maxWaitMicros);
+    fflush(stdout);
+
+    while (!daemonStopping) {
+        // Sleep until the oldest request's wait expires, or indefinitely;
+        // ppoll() keeps sub-millisecond waits exact
+        struct timespec wait;
+        struct timespec* timeout = NULL;
+        if (queued > 0) {
+            long long due = queue[0].arrived + maxWaitMicros * 1000LL - nowNanoseconds();
+            if (due < 0) due = 0;
+            wait.tv_sec = due / 1000000000LL;
+            wait.tv_nsec = due % 1000000000LL;
+            timeout = &wait;
+        }
+
+        int count = 0;
+        if (queued < DAEMON_MAX_QUEUE) {
+            polls[count].fd = listener;
+            polls[count].events = POLLIN;
+            pollClient[count++] = -1;
+        }
+        for (int i = 0; i < DAEMON_MAX_CLIENTS; i++) {
+            if (clients[i].fd < 0) continue;
+            short events = 0;
+            if (!clients[i].finished && queued < DAEMON_MAX_QUEUE && clients[i].outputUsed < DAEMON_OUTPUT_LIMIT) {
+                events |= POLLIN;
+            }
+            if (clients[i].outputUsed > clients[i].outputSent) events |= POLLOUT;
+            // Hangups are reported whatever the events, so a client with
+            // nothing to read or send would wake every poll until its
+            // queued requests run
+            if (!events) continue;
+            polls[count].fd = clients[i].fd;
+            polls[count].events = events;
+            pollClient[count++] = i;
+        }
+
+        int ready = ppoll(polls, count, timeout, NULL);
+        if (ready < 0 && errno != EINTR) {
+            fprintf(stderr, "poll failed: %s\n", strerror(errno));
+            break;
+        }
+
+        for (int p = 0; ready > 0 && p < count; p++) {
+            if (!polls[p].revents) continue;
+            int index = pollClient[p];
+            if (index < 0) {
+                int fd = accept(listener, NULL, NULL);
+                if (fd < 0) continue;
+                int slot = 0;
+                while (slot < DAEMON_MAX_CLIENTS && clients[slot].fd >= 0) slot++;
+                if (slot == DAEMON_MAX_CLIENTS) {
+                    close(fd);
+                    continue;
+                }
+                clients[slot].fd = fd;
+                continue;
+            }
+
+            int alive = 1;
+            if (polls[p].revents & POLLOUT) alive = sendClientOutput(&clients[index]);
+            if (alive && !clients[index].finished && (polls[p].revents & (POLLIN | POLLHUP | POLLERR))) {
+                alive = readDaemonClient(clients, index, queue, &queued);
+            }
+            if (!alive) closeDaemonClient(clients, index, queue, &queued);
+        }
+
+        // Frames left buffered while the queue was full
+        for (int i = 0; i < DAEMON_MAX_CLIENTS && queued < DAEMON_MAX_QUEUE; i++) {
+            if (clients[i].fd >= 0 && clients[i].inputUsed >= sizeof(SignalFrameHeader) &&
+                !parseDaemonClient(clients, i, queue, &queued)) {
+                closeDaemonClient(clients, i, queue, &queued);
+            }
+        }
+
+        // Run every batch that is full or due. A batch takes the oldest
+        // request and the queued requests of the same length, in order.
+        while (queued > 0) {
+            int length = queue[0].samples;
+            int same = 0;
+            for (int i = 0; i < queued && same < maxBatch; i++) {
+                if (queue[i].samples == length) same++;
+            }
+            if (same < maxBatch && nowNanoseconds() - queue[0].arrived < maxWaitMicros * 1000LL) break;
+
+            int size = 0;
+            int kept = 0;
+            for (int i = 0; i < queued; i++) {
+                if (size < maxBatch && queue[i].samples == length) {
+                    batch[size++] = queue[i];
+                } else {
+                    queue[kept++] = queue[i];
+                }
+            }
+            queued = kept;
+
+            if ((!ws || ws->inputLength != length) && badLength != length) {
+                freeWorkspace(ws, model);
+                free(inputs);
+                free(outputs);
+                inputs = outputs = NULL;
+                ws = createWorkspace(model, length);
+                if (ws) {
+                    inputs = (float*)malloc((size_t)maxBatch * length * sizeof(float));
+                    outputs = (float*)malloc((size_t)maxBatch * ws->numChains * ws->outputLength * sizeof(float));
+                    if (!inputs || !outputs) {
+                        fprintf(stderr, "Memory allocation failed for daemon batch\n");
+                        exit(EXIT_FAILURE);
+                    }
+                } else {
+                    badLength = length;
+                }
+            }
+
+            ResultFrameHeader result = {RESULT_FRAME_MAGIC, FRAME_STATUS_BAD_LENGTH, 0, 0};
+            size_t outputStride = 0;
+            long long started = nowNanoseconds();
+            long long computeTime = 0;
+            if (ws && ws->inputLength == length) {
+                for (int i = 0; i < size; i++) {
+                    memcpy(inputs + (size_t)i * length, batch[i].data, (size_t)length * sizeof(float));
+                }
+                inferBatch(model, ws, inputs, size, outputs);
+                computeTime = nowNanoseconds() - started;
+                result.status = FRAME_STATUS_OK;
+                result.chains = ws->numChains;
+                result.length = ws->outputLength;
+                outputStride = (size_t)ws->numChains * ws->outputLength;
+                batches++;
+                requests += size;
+            } else {
+                rejected += size;
+            }
+
+            for (int i = 0; i < size; i++) {
+                DaemonClient* client = &clients[batch[i].client];
+                queueClientOutput(client, &result, sizeof(result));
+                if (outputStride > 0) {
+                    queueClientOutput(client, outputs + i * outputStride, outputStride * sizeof(float));
+                }
+                recordLatency(&queueTimes, started - batch[i].arrived);
+                if (result.status == FRAME_STATUS_OK) recordLatency(&computeTimes, computeTime);
+                free(batch[i].data);
+            }
+
+            // Replies go out right away; whatever the socket does not take
+            // waits for POLLOUT
+            for (int i = 0; i < size; i++) {
+                int index = batch[i].client;
+                if (clients[index].fd >= 0 && !sendClientOutput(&clients[index])) {
+                    closeDaemonClient(clients, index, queue, &queued);
+                }
+            }
+        }
+
+        for (int i = 0; i < DAEMON_MAX_CLIENTS; i++) {
+            if (clients[i].fd < 0 || !clients[i].finished || clients[i].outputUsed > clients[i].outputSent) continue;
+            int waiting = clients[i].inputUsed >= sizeof(SignalFrameHeader);
+            for (int q = 0; q < queued && !waiting; q++) waiting = queue[q].client == i;
+            if (!waiting) closeDaemonClient(clients, i, queue, &queued);
+        }
+    }
+
+    printf("Requests: %ld in %ld batches (mean batch %.1f)\n", requests, batches,
+           batches ? (double)requests / batches : 0.0);
+    if (rejected > 0) printf("Rejected (unsupported length): %ld\n", rejected);
+    printLatencySummary("queue", &queueTimes);
+    printLatencySummary("compute", &computeTimes);
+
+    for (int i = 0; i < DAEMON_MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0) closeDaemonClient(clients, i, queue, &queued);
+    }
+    for (int i = 0; i < queued; i++) free(queue[i].data);
+    close(listener);
+    unlink(socketPath);
+    free(inputs);
+    free(outputs);
+    freeWorkspace(ws, model);
+    free(queueTimes.values);
+    free(computeTimes.values);
+    free(pollClient);
+    free(polls);
+    free(batch);
+    free(queue);
+    free(clients);
+    return EXIT_SUCCESS;
+}
+
+// Shared-memory ingestion for --shm. The engine creates one POSIX shared
+// memory object holding two rings of fixed-size slots: producers write
+// signals into the input ring and the engine publishes results into the
+// result ring. Signals are read and results written in place in the shared
+// pages, so nothing is copied or touches the filesystem.
+//
+// Each ring is a bounded multi-producer multi-consumer queue with a sequence
+// number per slot (the Vyukov design): a writer claims position pos by CAS on
+// reserve once slot sequence == pos, fills it and sets sequence = pos + 1; a
+// reader claims it by CAS on tail once sequence == pos + 1 and frees it with
+// sequence = pos + slotCount. Blocked sides sleep on futex words that are
+// only woken when someone is actually waiting. Results carry the id the
+// producer gave its signal; with several producers, one collector should own
+// the result ring and route results by id.
+#define SHM_MAGIC "CNNSHM1"
+#define SHM_VERSION 1
+#define SHM_ALIGNMENT 64
+#define SHM_WAIT_NANOS 100000000L   // futex waits wake up to notice shutdown
+
+typedef struct {
+    _Atomic uint64_t sequence;
+    uint64_t id;          // chosen by the producer, copied to the result
+    uint32_t count;       // floats used in data
+    uint32_t status;      // FRAME_STATUS_* in result slots
+    char padding[SHM_ALIGNMENT - 24];
+    float data[];
+} ShmSlot;
+
+typedef struct {
+    uint32_t slotCount;   // power of two
+    uint32_t slotFloats;
+    uint64_t slotBytes;
+    uint64_t slotsOffset; // from the start of the shared object
+    char padding0[SHM_ALIGNMENT - 24];
+    _Atomic uint64_t reserve;
+    char padding1[SHM_ALIGNMENT - 8];
+    _Atomic uint64_t tail;
+    char padding2[SHM_ALIGNMENT - 8];
+    _Atomic uint32_t published;       // futex word bumped by every write
+    _Atomic uint32_t readersWaiting;
+    char padding3[SHM_ALIGNMENT - 8];
+    _Atomic uint32_t released;        // futex word bumped by every read
+    _Atomic uint32_t writersWaiting;
+    char padding4[SHM_ALIGNMENT - 8];
+} ShmRingHeader;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    _Atomic uint32_t ready;           // set once both rings are initialized
+    uint64_t totalBytes;
+    uint32_t signalLength;
+    uint32_t resultLength;
+    char padding[SHM_ALIGNMENT - 32];
+    ShmRingHeader input;
+    ShmRingHeader results;
+} ShmHeader;
+
+typedef struct {
+    ShmHeader* header;
+    size_t bytes;
+} SharedRings;
+
+void futexWait(_Atomic uint32_t* word, uint32_t expected, long timeoutNanos) {
+    struct timespec timeout = {timeoutNanos / 1000000000L, timeoutNanos % 1000000000L};
+    syscall(SYS_futex, word, FUTEX_WAIT, expected, &timeout, NULL, 0);
+}
+
+void futexWake(_Atomic uint32_t* word) {
+    syscall(SYS_futex, word, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+}
+
+ShmSlot* ringSlot(const SharedRings* rings, const ShmRingHeader* ring, uint64_t position) {
+    char* base = (char*)rings->header + ring->slotsOffset;
+    return (ShmSlot*)(base + (position & (ring->slotCount - 1)) * ring->slotBytes);
+}
+
+// Claims the next free slot for writing, or returns NULL if the ring is full
+ShmSlot* tryAcquireWrite(const SharedRings* rings, ShmRingHeader* ring, uint64_t* position) {
+    uint64_t pos = atomic_load_explicit(&ring->reserve, memory_order_relaxed);
+    for (;;) {
+        ShmSlot* slot = ringSlot(rings, ring, pos);
+        int64_t diff = (int64_t)(atomic_load_explicit(&slot->sequence, memory_order_acquire) - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->reserve, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                *position = pos;
+                return slot;
+            }
+        } else if (diff < 0) {
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&ring->reserve, memory_order_relaxed);
+        }
+    }
+}
+
+void publishWrite(ShmRingHeader* ring, ShmSlot* slot, uint64_t position) {
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+    atomic_fetch_add(&ring->published, 1);
+    if (atomic_load(&ring->readersWaiting)) futexWake(&ring->published);
+}
+
+// Claims the oldest written slot for reading, or returns NULL if the ring is empty
+ShmSlot* tryAcquireRead(const SharedRings* rings, ShmRingHeader* ring, uint64_t* position) {
+    uint64_t pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    for (;;) {
+        ShmSlot* slot = ringSlot(rings, ring, pos);
+        int64_t diff = (int64_t)(atomic_load_explicit(&slot->sequence, memory_order_acquire) - (pos + 1));
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                *position = pos;
+                return slot;
+            }
+        } else if (diff < 0) {
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        }
+    }
+}
+
+void releaseRead(ShmRingHeader* ring, ShmSlot* slot, uint64_t position) {
+    atomic_store_explicit(&slot->sequence, position + ring->slotCount, memory_order_release);
+    atomic_fetch_add(&ring->released, 1);
+    if (atomic_load(&ring->writersWaiting)) futexWake(&ring->released);
+}
+
+// Sleep until something was written (or read, for waitForSpace) since the
+// caller last found the ring empty (or full), or the timeout passes
+void waitForData(const SharedRings* rings, ShmRingHeader* ring, long timeoutNanos) {
+    uint32_t seen = atomic_load(&ring->published);
+    atomic_fetch_add(&ring->readersWaiting, 1);
+    uint64_t tail = atomic_load(&ring->tail);
+    if (atomic_load(&ringSlot(rings, ring, tail)->sequence) != tail + 1) {
+        futexWait(&ring->published, seen, timeoutNanos);
+    }
+    atomic_fetch_sub(&ring->readersWaiting, 1);
+}
+
+void waitForSpace(const SharedRings* rings, ShmRingHeader* ring, long timeoutNanos) {
+    uint32_t seen = atomic_load(&ring->released);
+    atomic_fetch_add(&ring->writersWaiting, 1);
+    uint64_t reserve = atomic_load(&ring->reserve);
+    if (atomic_load(&ringSlot(rings, ring, reserve)->sequence) != reserve) {
+        futexWait(&ring->released, seen, timeoutNanos);
+    }
+    atomic_fetch_sub(&ring->writersWaiting, 1);
+}
+
+uint64_t initShmRing(ShmHeader* header, ShmRingHeader* ring, uint32_t slotCount, uint32_t slotFloats, uint64_t offset) {
+    ring->slotCount = slotCount;
+    ring->slotFloats = slotFloats;
+    ring->slotBytes = (sizeof(ShmSlot) + (uint64_t)slotFloats * sizeof(float) + SHM_ALIGNMENT - 1) & ~(uint64_t)(SHM_ALIGNMENT - 1);
+    ring->slotsOffset = offset;
+    for (uint32_t i = 0; i < slotCount; i++) {
+        ShmSlot* slot = (ShmSlot*)((char*)header + offset + i * ring->slotBytes);
+        atomic_init(&slot->sequence, i);
+    }
+    return offset + slotCount * ring->slotBytes;
+}
+
+uint64_t shmRingBytes(uint32_t slotCount, uint32_t slotFloats) {
+    uint64_t slotBytes = (sizeof(ShmSlot) + (uint64_t)slotFloats * sizeof(float) + SHM_ALIGNMENT - 1) & ~(uint64_t)(SHM_ALIGNMENT - 1);
+    return slotCount * slotBytes;
+}
+
+// Creates (replacing any stale object of the same name) and initializes the
+// shared rings. name is a POSIX shared memory name such as "/cnn".
+int createSharedRings(SharedRings* rings, const char* name, uint32_t slotCount, uint32_t signalLength, uint32_t resultLength) {
+    uint64_t bytes = sizeof(ShmHeader) + shmRingBytes(slotCount, signalLength) + shmRingBytes(slotCount, resultLength);
+
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 || ftruncate(fd, bytes) != 0) {
+        fprintf(stderr, "Error creating shared memory %s: %s\n", name, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+            shm_unlink(name);
+        }
+        return 0;
+    }
+
+    void* mapping = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "Error mapping shared memory %s: %s\n", name, strerror(errno));
+        shm_unlink(name);
+        return 0;
+    }
+
+    // ftruncate() zero-fills, so only the non-zero fields need setting
+    ShmHeader* header = (ShmHeader*)mapping;
+    memcpy(header->magic, SHM_MAGIC, sizeof(header->magic));
+    header->version = SHM_VERSION;
+    header->totalBytes = bytes;
+    header->signalLength = signalLength;
+    header->resultLength = resultLength;
+    uint64_t offset = initShmRing(header, &header->input, slotCount, signalLength, sizeof(ShmHeader));
+    initShmRing(header, &header->results, slotCount, resultLength, offset);
+    atomic_store(&header->ready, 1);
+
+    rings->header = header;
+    rings->bytes = bytes;
+    return 1;
+}
+
+int attachSharedRings(SharedRings* rings, const char* name) {
+    int fd = shm_open(name, O_RDWR, 0);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ShmHeader)) {
+        fprintf(stderr, "Error opening shared memory %s\n", name);
+        if (fd >= 0) close(fd);
+        return 0;
+    }
+
+    void* mapping = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "Error mapping shared memory %s\n", name);
+        return 0;
+    }
+
+    ShmHeader* header = (ShmHeader*)mapping;
+    if (memcmp(header->magic, SHM_MAGIC, sizeof(header->magic)) != 0 || header->version != SHM_VERSION ||
+        !atomic_load(&header->ready) || header->totalBytes != (uint64_t)st.st_size) {
+        fprintf(stderr, "Invalid shared memory %s\n", name);
+        munmap(mapping, st.st_size);
+        return 0;
+    }
+
+    rings->header = header;
+    rings->bytes = st.st_size;
+    return 1;
+}
+
+// Engine side: infers every signal in the input ring straight from its slot
+// into a result slot until SIGINT/SIGTERM. Producers set slot count to the
+// number of samples; a count other than signalLength is answered with
+// FRAME_STATUS_BAD_LENGTH.
+int runSharedMemory(const Model* model, const char* name, uint32_t slotCount, int signalLength) {
+    if (slotCount == 0 || (slotCount & (slotCount - 1)) != 0) {
+        fprintf(stderr, "Slot count must be a power of two\n");
+        return EXIT_FAILURE;
+    }
+
+    Workspace* ws = createWorkspace(model, signalLength);
+    if (!ws) return EXIT_FAILURE;
+
+    SharedRings rings;
+    uint32_t resultLength = ws->numChains * ws->outputLength;
+    if (!createSharedRings(&rings, name, slotCount, signalLength, resultLength)) {
+        freeWorkspace(ws, model);
+        return EXIT_FAILURE;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopDaemon;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    printf("Serving shared memory %s (%u slots, %d samples in, %u values out)\n", name, slotCount, signalLength, resultLength);
+    fflush(stdout);
+
+    ShmHeader* header = rings.header;
+    long processed = 0;
+    while (!daemonStopping) {
+        uint64_t inputPosition;
+        ShmSlot* input = tryAcquireRead(&rings, &header->input, &inputPosition);
+        if (!input) {
+            waitForData(&rings, &header->input, SHM_WAIT_NANOS);
+            continue;
+        }
+
+        uint64_t resultPosition;
+        ShmSlot* result;
+        while (!(result = tryAcquireWrite(&rings, &header->results, &resultPosition)) && !daemonStopping) {
+            waitForSpace(&rings, &header->results, SHM_WAIT_NANOS);
+        }
+        if (!result) break;
+
+        result->id = input->id;
+        if (input->count == (uint32_t)signalLength) {
+            inferWorkspace(model, ws, input->data, result->data);
+            result->count = resultLength;
+            result->status = FRAME_STATUS_OK;
+        } else {
+            result->count = 0;
+            result->status = FRAME_STATUS_BAD_LENGTH;
+        }
+        releaseRead(&header->input, input, inputPosition);
+        publishWrite(&header->results, result, resultPosition);
+        processed++;
+    }
+
+    printf("Signals: %ld\n", processed);
+    munmap(rings.header, rings.bytes);
+    shm_unlink(name);
+    freeWorkspace(ws, model);
+    return EXIT_SUCCESS;
+}
+
+// Takes one result off the ring and prints it as a text row. Returns 0 if
+// none is ready.
+int printSharedResult(SharedRings* rings, OutputWriter* writer) {
+    uint64_t position;
+    ShmSlot* slot = tryAcquireRead(rings, &rings->header->results, &position);
+    if (!slot) return 0;
+    writeText(writer, OUTPUT_FINAL, "%llu%s", (unsigned long long)slot->id, slot->count > 0 ? "," : "");
+    if (slot->count > 0) {
+        writeFloatsText(writer, slot->data, slot->count - 1, ',', "");
+        writeFloatsText(writer, slot->data + slot->count - 1, 1, '\n', "");
+    } else {
+        writeText(writer, OUTPUT_FINAL, "\n");
+    }
+    releaseRead(&rings->header->results, slot, position);
+    return 1;
+}
+
+// Producer side for --shm-produce: writes every row of a one-signal-per-row
+// CSV into the input ring, ids counting from 0, and prints each result as
+// "id,values..." while collecting them from the result ring. It expects to be
+// the only producer and the only result reader.
+int produceSharedMemory(const char* name, const char* filename) {
+    SharedRings rings;
+    if (!attachSharedRings(&rings, name)) return EXIT_FAILURE;
+
+    SignalReader* reader = openSignalReader(filename, 1);
+    if (!reader) {
+        munmap(rings.header, rings.bytes);
+        return EXIT_FAILURE;
+    }
+
+    OutputWriter writer;
+    initOutputWriter(&writer, stdout, NULL, OUTPUT_BUFFER_SIZE, OUTPUT_ALL, OUTPUT_TEXT);
+    ShmHeader* header = rings.header;
+    long sent = 0;
+    long received = 0;
+    int rows;
+
+    while ((rows = readSignalBatch(reader)) > 0) {
+        // Rows longer than a slot are truncated; the engine rejects them by count
+        uint32_t count = reader->rowLength;
+        if (count > header->input.slotFloats) count = header->input.slotFloats;
+        uint64_t position;
+        ShmSlot* slot;
+        // Collect results while the input ring is full so the engine never
+        // stalls on a full result ring
+        while (!(slot = tryAcquireWrite(&rings, &header->input, &position))) {
+            if (printSharedResult(&rings, &writer)) {
+                received++;
+            } else {
+                waitForData(&rings, &header->results, 1000000L);
+            }
+        }
+
+        slot->id = sent++;
+        slot->count = reader->rowLength;
+        memcpy(slot->data, reader->batch, count * sizeof(float));
+        publishWrite(&header->input, slot, position);
+
+        while (printSharedResult(&rings, &writer)) received++;
+    }
+
+    while (received < sent) {
+        if (printSharedResult(&rings, &writer)) {
+            received++;
+        } else {
+            waitForData(&rings, &header->results, SHM_WAIT_NANOS);
+        }
+    }
+
+    closeOutputWriter(&writer);
+    closeSignalReader(reader);
+    munmap(rings.header, rings.bytes);
+    return rows < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Turns a one-signal-per-row CSV into signal frames on stdout
+int encodeSignalFrames(const char* filename) {
+    SignalReader* reader = openSignalReader(filename, 1);
+    if (!reader) return EXIT_FAILURE;
+
+    OutputWriter writer;
+    initOutputWriter(&writer, stdout, NULL, OUTPUT_BUFFER_SIZE, OUTPUT_ALL, OUTPUT_BINARY);
+    int rows;
+    while ((rows = readSignalBatch(reader)) > 0) {
+        SignalFrameHeader header = {SIGNAL_FRAME_MAGIC, (uint32_t)reader->rowLength};
+        writeBytes(&writer, &header, sizeof(header));
+        writeBytes(&writer, reader->batch, (size_t)reader->rowLength * sizeof(float));
+    }
+    closeOutputWriter(&writer);
+    closeSignalReader(reader);
+    return rows < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Prints result frames from stdin as text, one comma-separated row per frame
+// and an empty row for rejected signals
+int decodeResultFrames(void) {
+    FrameReader reader = {STDIN_FILENO, NULL, SIGNAL_READER_BUFFER, 0, 0};
+    reader.buffer = (char*)malloc(reader.capacity);
+    if (!reader.buffer) {
+        fprintf(stderr, "Memory allocation failed for frame buffer\n");
+        exit(EXIT_FAILURE);
+    }
+
+    OutputWriter writer;
+    initOutputWriter(&writer, stdout, NULL, OUTPUT_BUFFER_SIZE, OUTPUT_ALL, OUTPUT_TEXT);
+    int status = EXIT_SUCCESS;
+
+    while (fillFrameReader(&reader, sizeof(ResultFrameHeader), NULL)) {
+        ResultFrameHeader header;
+        memcpy(&header, reader.buffer + reader.start, sizeof(header));
+        size_t count = (size_t)header.chains * header.length;
+        if (header.magic != RESULT_FRAME_MAGIC || count > FRAME_MAX_SAMPLES ||
+            !fillFrameReader(&reader, sizeof(header) + count * sizeof(float), NULL)) {
+            fprintf(stderr, "Invalid result frame\n");
+            status = EXIT_FAILURE;
+            break;
+        }
+
+        const float* values = (const float*)(reader.buffer + reader.start + sizeof(header));
+        if (count > 0) {
+            writeFloatsText(&writer, values, count - 1, ',', "");
+            writeFloatsText(&writer, values + count - 1, 1, '\n', "");
+        } else {
+            writeText(&writer, OUTPUT_FINAL, "\n");
+        }
+        reader.start += sizeof(header) + count * sizeof(float);
+    }
+
+    closeOutputWriter(&writer);
+    free(reader.buffer);
+    return status;
+}
+
+// The current reader's method (fgets into 8192 bytes, strtok, atof) without
+// its 2000 value cap, used as the baseline for --bench-load
+long legacyCSVLoad(const char* filename, double* checksum) {
+    FILE* file = fopen(filename, "r");
+    if (!file) {
+        fprintf(stderr, "Error opening file: %s\n", filename);
+        return -1;
+    }
+
+    long capacity = 1 << 16;
+    long totalValues = 0;
+    float* values = (float*)malloc(capacity * sizeof(float));
+    if (!values) {
+        fprintf(stderr, "Memory allocation failed for temporary storage\n");
+        exit(EXIT_FAILURE);
+    }
+
+    char line[8192];
+    while (fgets(line, sizeof(line), file)) {
+        char* token = strtok(line, ", \n");
+        while (token) {
+            if (totalValues == capacity) {
+                capacity *= 2;
+                values = (float*)realloc(values, capacity * sizeof(float));
+                if (!values) {
+                    fprintf(stderr, "Memory allocation failed for temporary storage\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            values[totalValues++] = atof(token);
+            token = strtok(NULL, ", \n");
+        }
+    }
+    fclose(file);
+
+    *checksum = 0;
+    for (long i = 0; i < totalValues; i++) *checksum += values[i];
+    free(values);
+    return totalValues;
+}
+
+// Times the legacy fgets/strtok reader against the mmap loader on one file
+int runLoadBenchmark(const char* filename, int repetitions) {
+    struct stat st;
+    if (stat(filename, &st) != 0) {
+        fprintf(stderr, "Error opening file: %s\n", filename);
+        return EXIT_FAILURE;
+    }
+    double megabytes = st.st_size / (1024.0 * 1024.0);
+
+    double legacyBest = INFINITY, mappedBest = INFINITY;
+    long legacyValues = 0, mappedValues = 0;
+    double legacySum = 0, mappedSum = 0;
+
+    for (int r = 0; r < repetitions; r++) {
+        long long start = nowNanoseconds();
+        legacyValues = legacyCSVLoad(filename, &legacySum);
+        double elapsed = (nowNanoseconds() - start) / 1e9;
+        if (legacyValues < 0) return EXIT_FAILURE;
+        if (elapsed < legacyBest) legacyBest = elapsed;
+
+        start = nowNanoseconds();
+        Matrix* matrix = readMatrixFromCSVMapped(filename);
+        elapsed = (nowNanoseconds() - start) / 1e9;
+        if (!matrix) return EXIT_FAILURE;
+        if (elapsed < mappedBest) mappedBest = elapsed;
+
+        mappedValues = matrix->cols;
+        mappedSum = 0;
+        for (int i = 0; i < matrix->cols; i++) mappedSum += matrix->data[0][i];
+        freeMatrix(matrix);
+    }
+
+    printf("File: %s (%.1f MB), best of %d\n", filename, megabytes, repetitions);
+    printf("fgets/strtok/atof: %8.3f s %8.1f MB/s %ld values (checksum %f)\n",
+           legacyBest, megabytes / legacyBest, legacyValues, legacySum);
+    printf("mmap/parseDecimal: %8.3f s %8.1f MB/s %ld values (checksum %f)\n",
+           mappedBest, megabytes / mappedBest, mappedValues, mappedSum);
+    printf("Speedup: %.2fx\n", legacyBest / mappedBest);
+    if (legacyValues != mappedValues) {
+        printf("Note: value counts differ, the legacy reader splits tokens at its 8192 byte buffer boundary\n");
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// ... [All previous functions remain the same until main()]
+
+// Set by --trace; every mode returns through main or exit(), so the trace is
+// written by an atexit handler
+static const char* traceFile = NULL;
+
+void writeTraceOnExit(void) {
+    stopTracing();
+    writeChromeTrace(traceFile);
+}
+
+int main(int argc, char* argv[]) {
+    const char* inputFile = "test.csv";
+    const char* filterFiles[3] = {
+        "CNN_layer_1_filter_weights.csv",
+        "CNN_layer_2_filter_weights.csv",
+        "CNN_layer_3_filter_weights.csv"
+    };
+    const char* biasFiles[3] = {
+        "CNN_layer_1_filter_bias.csv",
+        "CNN_layer_2_filter_bias.csv",
+        "CNN_layer_3_filter_bias.csv"
+    };
+
+    // Configuration parameters
+    int stride = 2;
+    int poolRows = 5;
+    int poolCols = 1;
+    int poolStride = 5;
+
+    // --model <file> loads a binary model instead of parsing the CSVs
+    const char* modelFile = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
+            modelFile = argv[i + 1];
+            for (int j = i; j + 2 <= argc; j++) {
+                argv[j] = argv[j + 2];
+            }
+            argc -= 2;
+            break;
+        }
+    }
+
+    // --verbosity final|layers|all selects how much is written (default all)
+    // and --binary writes raw float32 records instead of text. --dump <dir>
+    // writes activations as .npy files, --dump-select picks them (e.g.
+    // "conv1,pool3", default all). --pack-cache keeps the prepacked weights
+    // of a --model file in <model>.pack for later runs. --trace <file> records
+    // spans for loading, each layer's conv and pool and output, and writes
+    // them as Chrome trace-event JSON on exit. --counters reads perf_event
+    // counters around each layer's conv and pool in --batch and --realtime
+    // and prints them per layer to stderr
+    OutputVerbosity verbosity = OUTPUT_ALL;
+    OutputFormat format = OUTPUT_TEXT;
+    const char* dumpDir = NULL;
+    const char* dumpSelection = "all";
+    int packCache = 0;
+    int countLayers = 0;
+    for (int i = 1; i < argc;) {
+        int consumed = 0;
+        if (strcmp(argv[i], "--verbosity") == 0 && i + 1 < argc) {
+            if (strcmp(argv[i + 1], "final") == 0) {
+                verbosity = OUTPUT_FINAL;
+            } else if (strcmp(argv[i + 1], "layers") == 0) {
+                verbosity = OUTPUT_LAYERS;
+            } else if (strcmp(argv[i + 1], "all") == 0) {
+                verbosity = OUTPUT_ALL;
+            } else {
+                fprintf(stderr, "Unknown verbosity: %s\n", argv[i + 1]);
+                return EXIT_FAILURE;
+            }
+            consumed = 2;
+        } else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+            dumpDir = argv[i + 1];
+            consumed = 2;
+        } else if (strcmp(argv[i], "--dump-select") == 0 && i + 1 < argc) {
+            dumpSelection = argv[i + 1];
+            consumed = 2;
+        } else if (strcmp(argv[i], "--pack-cache") == 0) {
+            packCache = 1;
+            consumed = 1;
+        } else if (strcmp(argv[i], "--binary") == 0) {
+            format = OUTPUT_BINARY;
+            consumed = 1;
+        } else if (strcmp(argv[i], "--counters") == 0) {
+            countLayers = 1;
+            consumed = 1;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            traceFile = argv[i + 1];
+            startTracing(0);
+            atexit(writeTraceOnExit);
+            consumed = 2;
+        }
+
+        if (!consumed) {
+            i++;
+            continue;
+        }
+        for (int j = i; j + consumed <= argc; j++) {
+            argv[j] = argv[j + consumed];
+        }
+        argc -= consumed;
+    }
+
+    // --stream [file] reads samples continuously from the file (or stdin)
+    // and emits each final output as soon as its receptive field is complete
+    int streamMode = argc > 1 && strcmp(argv[1], "--stream") == 0;
+    // --realtime [iterations] [cpu] [latency file] times single-signal
+    // inferences with no output other than the final latency report
+    int realtimeMode = argc > 1 && strcmp(argv[1], "--realtime") == 0;
+    // --roofline [iterations] profiles each layer of test.csv inferences
+    // against the analytic FLOPs and bytes and the machine's measured peaks
+    int rooflineMode = argc > 1 && strcmp(argv[1], "--roofline") == 0;
+    // --depth-first [tile] [iterations] [signal length] compares depth-first
+    // tiled inference with the row-at-a-time workspace and reports the
+    // intermediate memory traffic each moves beyond L1
+    int depthFirstMode = argc > 1 && strcmp(argv[1], "--depth-first") == 0;
+    // --batch <file|-> [batch size] runs every row of a one-signal-per-row CSV
+    int batchMode = argc > 2 && strcmp(argv[1], "--batch") == 0;
+    // --convert-model <file> writes the CSV model in binary form
+    int convertMode = argc > 2 && strcmp(argv[1], "--convert-model") == 0;
+    // --frames serves binary signal frames from stdin until end of input
+    int framesMode = argc > 1 && strcmp(argv[1], "--frames") == 0;
+    // --daemon <socket> [max batch] [max wait us] serves the frames protocol
+    // on a Unix domain socket, batching requests across connections
+    int daemonMode = argc > 2 && strcmp(argv[1], "--daemon") == 0;
+    // --shm <name> <signal length> [slots] consumes signals from shared
+    // memory rings that --shm-produce <name> <file|-> (or any producer) fills
+    int shmMode = argc > 3 && strcmp(argv[1], "--shm") == 0;
+
+    // --encode-frames <file|-> and --decode-results convert between CSV/text
+    // and the --frames protocol for use in shell pipelines
+    if (argc > 2 && strcmp(argv[1], "--encode-frames") == 0) {
+        return encodeSignalFrames(argv[2]);
+    }
+    if (argc > 1 && strcmp(argv[1], "--decode-results") == 0) {
+        return decodeResultFrames();
+    }
+    if (argc > 3 && strcmp(argv[1], "--shm-produce") == 0) {
+        return produceSharedMemory(argv[2], argv[3]);
+    }
+
+    // --bench-load <file> [repetitions] compares CSV loaders on one file
+    if (argc > 2 && strcmp(argv[1], "--bench-load") == 0) {
+        return runLoadBenchmark(argv[2], argc > 3 ? atoi(argv[3]) : 3);
+    }
+
+    // Read all layer filters and biases
+    Model model;
+    uint64_t span = traceBegin();
+    int loaded = modelFile ? loadModelBinary(&model, modelFile)
+                           : loadModelFromCSV(&model, 3, filterFiles, biasFiles, stride, poolRows, poolCols, poolStride);
+    traceEnd("load model", -1, span);
+    if (!loaded) {
+        fprintf(stderr, "Failed to read one or more filter or bias matrices\n");
+        return EXIT_FAILURE;
+    }
+
+    if (convertMode) {
+        int status = saveModelBinary(&model, argv[2]) ? EXIT_SUCCESS : EXIT_FAILURE;
+        freeModel(&model);
+        return status;
+    }
+
+    span = traceBegin();
+    prepackModel(&model, packCache ? modelFile : NULL);
+    traceEnd("pack model", -1, span);
+
+    OutputWriter writer;
+    initOutputWriter(&writer, stdout, NULL, OUTPUT_BUFFER_SIZE, verbosity, format);
+
+    if (batchMode) {
+        int batchSize = argc > 3 ? atoi(argv[3]) : 64;
+        int status = batchSize > 0 ? runBatchFile(&model, argv[2], batchSize, &writer, dumpDir, dumpSelection, countLayers) : EXIT_FAILURE;
+        closeOutputWriter(&writer);
+        freeModel(&model);
+        return status;
+    }
+
+    if (framesMode) {
+        int status = runFrames(&model, &writer);
+        closeOutputWriter(&writer);
+        freeModel(&model);
+        return status;
+    }
+
+    if (daemonMode) {
+        int maxBatch = argc > 3 ? atoi(argv[3]) : 32;
+        long maxWait = argc > 4 ? atol(argv[4]) : 1000;
+        int status = maxBatch > 0 && maxWait >= 0 ? runDaemon(&model, argv[2], maxBatch, maxWait) : EXIT_FAILURE;
+        closeOutputWriter(&writer);
+        freeModel(&model);
+        return status;
+    }
+
+    if (shmMode) {
+        int status = runSharedMemory(&model, argv[2], argc > 4 ? atoi(argv[4]) : 64, atoi(argv[3]));
+        closeOutputWriter(&writer);
+        freeModel(&model);
+        return status;
+    }
+
+    if (streamMode) {
+        FILE* source = stdin;
+        if (argc > 2) {
+            source = fopen(argv[2], "r");
+            if (!source) {
+                fprintf(stderr, "Error opening file: %s\n", argv[2]);
+            }
+        }
+
+        int status = source ? runStreaming(&model, source, &writer) : EXIT_FAILURE;
+        if (source && source != stdin) fclose(source);
+
+        closeOutputWriter(&writer);
+        freeModel(&model);
+        return status;
+    }
+
+    span = traceBegin();
+    Matrix* inputMatrix = readMatrixFromCSVMapped(inputFile);
+    traceEnd("read input", -1, span);
+    if (!inputMatrix) {
+        fprintf(stderr, "Failed to read input matrix\n");
+        closeOutputWriter(&writer);
+        freeModel(&model);
+        return EXIT_FAILURE;
+    }
+
+    if (realtimeMode) {
+        long iterations = argc > 2 ? atol(argv[2]) : 100000;
+        int cpu = argc > 3 ? atoi(argv[3]) : -1;
+        const char* latencyFile = argc > 4 ? argv[4] : NULL;
+
+        int status = iterations > 0 ? runRealtime(&model, inputMatrix, iterations, cpu, latencyFile, countLayers) : EXIT_FAILURE;
+
+        closeOutputWriter(&writer);
+        freeMatrix(inputMatrix);
+        freeModel(&model);
+        return status;
+    }
+
+    if (rooflineMode) {
+        long iterations = argc > 2 ? atol(argv[2]) : 2000;
+        int status = iterations > 0 ? runRoofline(&model, inputMatrix, iterations) : EXIT_FAILURE;
+
+        closeOutputWriter(&writer);
+        freeMatrix(inputMatrix);
+        freeModel(&model);
+        return status;
+    }
+
+    if (depthFirstMode) {
+        int tileLength = argc > 2 ? atoi(argv[2]) : 0;
+        long iterations = argc > 3 ? atol(argv[3]) : 200;
+        int signalLength = argc > 4 ? atoi(argv[4]) : 0;
+        int status = iterations > 0 ? runDepthFirst(&model, inputMatrix, tileLength, iterations, signalLength)
+                                    : EXIT_FAILURE;
+
+        closeOutputWriter(&writer);
+        freeMatrix(inputMatrix);
+        freeModel(&model);
+        return status;
+    }
+
+    // The layer-by-layer run below goes through convolve(), which always
+    // applies leakyRelu, over exactly three layers
+    int layerByLayer = model.numLayers == 3;
+    for (int l = 0; l < model.numLayers; l++) {
+        if (model.layers[l].activation != ACTIVATION_LEAKY_RELU || model.layers[l].alpha != 0.1f) {
+            layerByLayer = 0;
+        }
+    }
+    if (!layerByLayer) {
+        fprintf(stderr, "Layer-by-layer output needs three leaky relu layers, use --stream or --realtime\n");
+        closeOutputWriter(&writer);
+        freeMatrix(inputMatrix);
+        freeModel(&model);
+        return EXIT_FAILURE;
+    }
+
+    if (dumpDir) {
+        Workspace* ws = createWorkspace(&model, inputMatrix->cols);
+        float* output = ws ? (float*)malloc((size_t)ws->numChains * ws->outputLength * sizeof(float)) : NULL;
+        if (ws && output) {
+            ws->dump = createActivationDump(dumpDir, dumpSelection, &model, ws, 0);
+        }
+        if (!ws || !output || !ws->dump) {
+            fprintf(stderr, "Failed to dump activations to %s\n", dumpDir);
+        } else {
+            inferWorkspace(&model, ws, inputMatrix->data[0], output);
+            closeActivationDump(ws->dump);
+        }
+        free(output);
+        freeWorkspace(ws, &model);
+    }
+
+    writeText(&writer, OUTPUT_ALL, "\nInput Matrix:\n");
+    writeMatrix(&writer, RECORD_INPUT, -1, NULL, 0, inputMatrix);
+
+    Layer* firstLayer = &model.layers[0];
+    Layer* secondLayer = &model.layers[1];
+    Layer* thirdLayer = &model.layers[2];
+    Matrix* filtersMatrix = firstLayer->filters;
+    Matrix* biasesMatrix = firstLayer->biases;
+    Matrix* secondLayerFiltersMatrix = secondLayer->filters;
+    Matrix* secondLayerBiasesMatrix = secondLayer->biases;
+    Matrix* thirdLayerFiltersMatrix = thirdLayer->filters;
+    Matrix* thirdLayerBiasesMatrix = thirdLayer->biases;
+    int filterRows = 1;
+    int filterCols = filtersMatrix->cols;
+
+    // Print all matrices
+    writeText(&writer, OUTPUT_ALL, "\nFilters Matrix (First Layer):\n");
+    writeMatrix(&writer, RECORD_WEIGHTS, 0, NULL, 0, filtersMatrix);
+    writeText(&writer, OUTPUT_ALL, "\nBiases Matrix (First Layer):\n");
+    writeMatrix(&writer, RECORD_BIASES, 0, NULL, 0, biasesMatrix);
+    writeText(&writer, OUTPUT_ALL, "\nSecond Layer Filters Matrix:\n");
+    writeMatrix(&writer, RECORD_WEIGHTS, 1, NULL, 0, secondLayerFiltersMatrix);
+    writeText(&writer, OUTPUT_ALL, "\nSecond Layer Biases Matrix:\n");
+    writeMatrix(&writer, RECORD_BIASES, 1, NULL, 0, secondLayerBiasesMatrix);
+    writeText(&writer, OUTPUT_ALL, "\nThird Layer Filters Matrix:\n");
+    writeMatrix(&writer, RECORD_WEIGHTS, 2, NULL, 0, thirdLayerFiltersMatrix);
+    writeText(&writer, OUTPUT_ALL, "\nThird Layer Biases Matrix:\n");
+    writeMatrix(&writer, RECORD_BIASES, 2, NULL, 0, thirdLayerBiasesMatrix);
+
+    int numFilters = filtersMatrix->rows / filterRows;
+
+    // Process first layer
+    writeText(&writer, OUTPUT_ALL, "\n=== Processing First Layer ===\n");
+    int chain[3];
+    for (int f = 0; f < numFilters; f++) {
+        chain[0] = f;
+        // Create current filter for first layer
+        Matrix* currentFilter = createMatrix(filterRows, filterCols);
+        for (int i = 0; i < filterRows; i++) {
+            for (int j = 0; j < filterCols; j++) {
+                currentFilter->data[i][j] = filtersMatrix->data[f * filterRows + i][j];
+            }
+        }
+
+        // Create current bias for first layer
+        Matrix* currentBias = createMatrix(1, 1);
+        currentBias->data[0][0] = biasesMatrix->data[f][0];
+
+        // First layer convolution
+        writeText(&writer, OUTPUT_LAYERS, "\nFirst Layer - Processing Filter %d:\n", f + 1);
+        Matrix* firstLayerResult = convolve(inputMatrix, currentFilter, currentBias, firstLayer->stride);
+        if (firstLayerResult) {
+            writeText(&writer, OUTPUT_LAYERS, "First Layer Convolution Output:\n");
+            writeMatrix(&writer, RECORD_CONV, 0, chain, 1, firstLayerResult);
+
+            // First layer pooling
+            Matrix* firstLayerPooled = maxPool(firstLayerResult, firstLayer->poolRows, firstLayer->poolCols, firstLayer->poolStride);
+            if (firstLayerPooled) {
+                writeText(&writer, OUTPUT_LAYERS, "First Layer Pooling Output:\n");
+                writeMatrix(&writer, RECORD_POOL, 0, chain, 1, firstLayerPooled);
+
+                // Second layer processing
+                int numSecondLayerFilters = secondLayerFiltersMatrix->rows;
+                for (int sf = 0; sf < numSecondLayerFilters; sf++) {
+                    chain[1] = sf;
+                    // Create second layer filter and bias
+                    Matrix* secondFilter = createMatrix(1, secondLayerFiltersMatrix->cols);
+                    for (int j = 0; j < secondLayerFiltersMatrix->cols; j++) {
+                        secondFilter->data[0][j] = secondLayerFiltersMatrix->data[sf][j];
+                    }
+                    
+                    Matrix* secondBias = createMatrix(1, 1);
+                    secondBias->data[0][0] = secondLayerBiasesMatrix->data[sf][0];
+
+                    // Second layer convolution
+                    writeText(&writer, OUTPUT_LAYERS, "\nSecond Layer - Processing Filter Chain %d-%d:\n", f + 1, sf + 1);
+                    Matrix* secondLayerResult = convolve(firstLayerPooled, secondFilter, secondBias, secondLayer->stride);
+                    if (secondLayerResult) {
+                        writeText(&writer, OUTPUT_LAYERS, "Second Layer Convolution Output:\n");
+                        writeMatrix(&writer, RECORD_CONV, 1, chain, 2, secondLayerResult);
+
+                        // Second layer pooling
+                        Matrix* secondLayerPooled = maxPool(secondLayerResult, secondLayer->poolRows, secondLayer->poolCols, secondLayer->poolStride);
+                        if (secondLayerPooled) {
+                            writeText(&writer, OUTPUT_LAYERS, "Second Layer Pooling Output:\n");
+                            writeMatrix(&writer, RECORD_POOL, 1, chain, 2, secondLayerPooled);
+
+                            // Third layer processing
+                            int numThirdLayerFilters = thirdLayerFiltersMatrix->rows;
+                            for (int tf = 0; tf < numThirdLayerFilters; tf++) {
+                                chain[2] = tf;
+                                // Create third layer filter and bias
+                                Matrix* thirdFilter = createMatrix(1, thirdLayerFiltersMatrix->cols);
+                                for (int j = 0; j < thirdLayerFiltersMatrix->cols; j++) {
+                                    thirdFilter->data[0][j] = thirdLayerFiltersMatrix->data[tf][j];
+                                }
+                                
+                                Matrix* thirdBias = createMatrix(1, 1);
+                                thirdBias->data[0][0] = thirdLayerBiasesMatrix->data[tf][0];
+
+                                // Third layer convolution
+                                writeText(&writer, OUTPUT_LAYERS, "\nThird Layer - Processing Filter Chain %d-%d-%d:\n", f + 1, sf + 1, tf + 1);
+                                Matrix* thirdLayerResult = convolve(secondLayerPooled, thirdFilter, thirdBias, thirdLayer->stride);
+                                if (thirdLayerResult) {
+                                    writeText(&writer, OUTPUT_LAYERS, "Third Layer Convolution Output:\n");
+                                    writeMatrix(&writer, RECORD_CONV, 2, chain, 3, thirdLayerResult);
+
+                                    // Third layer pooling
+                                    Matrix* thirdLayerPooled = maxPool(thirdLayerResult, thirdLayer->poolRows, thirdLayer->poolCols, thirdLayer->poolStride);
+                                    if (thirdLayerPooled) {
+                                        writeText(&writer, OUTPUT_FINAL, "Third Layer Final Output (Filter Chain %d-%d-%d):\n", f + 1, sf + 1, tf + 1);
+                                        writeMatrix(&writer, RECORD_FINAL, 2, chain, 3, thirdLayerPooled);
+                                        freeMatrix(thirdLayerPooled);
+                                    }
+                                    freeMatrix(thirdLayerResult);
+                                }
+                                freeMatrix(thirdFilter);
+                                freeMatrix(thirdBias);
+                            }
+                            freeMatrix(secondLayerPooled);
+                        }
+                        freeMatrix(secondLayerResult);
+                    }
+                    freeMatrix(secondFilter);
+                    freeMatrix(secondBias);
+                }
+                freeMatrix(firstLayerPooled);
+            }
+            freeMatrix(firstLayerResult);
+        }
+        freeMatrix(currentFilter);
+        freeMatrix(currentBias);
+    }
+
+    closeOutputWriter(&writer);
+
     // Free all matrices
     freeMatrix(inputMatrix);
-    freeMatrix(filtersMatrix);
-    freeMatrix(biasesMatrix);
-    freeMatrix(secondLayerFiltersMatrix);
-    freeMatrix(secondLayerBiasesMatrix);
-    freeMatrix(thirdLayerFiltersMatrix);
-    freeMatrix(thirdLayerBiasesMatrix);
+    freeModel(&model);
 
     return EXIT_SUCCESS;
 }
\ No newline at end of file
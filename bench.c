@@ -0,0 +1,520 @@
+// Microbenchmarks for the kernels and loaders in libcnn.c. Build with
+//
+//   gcc -O2 -o bench bench.c libcnn.c -lm -lpthread
+//
+// Every case is warmed up, then timed over repeated samples; each sample runs
+// the operation enough times to last at least BENCH_MIN_SAMPLE_NS and the
+// per-call time is reported as median and p95 over the samples.
+//
+//   bench [--reps N] [--warmup N] [--filter text] [--json file]
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "cnncore.h"
+
+#define BENCH_MIN_SAMPLE_NS 200000LL
+#define BENCH_MAX_RESULTS 512
+
+typedef void (*BenchFn)(void* arg);
+
+typedef struct {
+    char name[48];
+    char params[64];
+    long iterations;      // calls per sample
+    double medianNs;      // per call
+    double p95Ns;
+    double items;         // elements processed per call, for the throughput column
+} BenchResult;
+
+typedef struct {
+    int repetitions;
+    int warmup;
+    const char* filter;
+    BenchResult results[BENCH_MAX_RESULTS];
+    int count;
+} BenchSuite;
+
+long long benchNanoseconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Keeps results observable so the compiler cannot drop the timed work
+volatile float benchSink;
+
+void runBenchmark(BenchSuite* suite, const char* name, const char* params, double items, BenchFn fn, void* arg) {
+    if (suite->filter && !strstr(name, suite->filter)) return;
+    if (suite->count == BENCH_MAX_RESULTS) {
+        fprintf(stderr, "Too many benchmark cases\n");
+        return;
+    }
+
+    // Grow the calls per sample until a sample is long enough to time
+    long iterations = 1;
+    for (;;) {
+        long long start = benchNanoseconds();
+        for (long i = 0; i < iterations; i++) fn(arg);
+        if (benchNanoseconds() - start >= BENCH_MIN_SAMPLE_NS || iterations >= (1L << 30)) break;
+        iterations *= 2;
+    }
+
+    for (int w = 0; w < suite->warmup; w++) {
+        for (long i = 0; i < iterations; i++) fn(arg);
+    }
+
+    double* samples = (double*)malloc(suite->repetitions * sizeof(double));
+    if (!samples) {
+        fprintf(stderr, "Memory allocation failed for benchmark samples\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int r = 0; r < suite->repetitions; r++) {
+        long long start = benchNanoseconds();
+        for (long i = 0; i < iterations; i++) fn(arg);
+        samples[r] = (double)(benchNanoseconds() - start) / iterations;
+    }
+    qsort(samples, suite->repetitions, sizeof(double), compareDoubles);
+
+    BenchResult* result = &suite->results[suite->count++];
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    snprintf(result->params, sizeof(result->params), "%s", params);
+    result->iterations = iterations;
+    result->medianNs = samples[suite->repetitions / 2];
+    result->p95Ns = samples[(int)((suite->repetitions - 1) * 0.95)];
+    result->items = items;
+    free(samples);
+
+    printf("%-24s %-26s %12.1f %12.1f %10.2f\n", result->name, result->params,
+           result->medianNs, result->p95Ns, items > 0 ? items / result->medianNs * 1e3 : 0.0);
+    fflush(stdout);
+}
+
+int writeBenchJSON(const BenchSuite* suite, const char* filename) {
+    FILE* file = fopen(filename, "w");
+    if (!file) {
+        fprintf(stderr, "Error opening file: %s\n", filename);
+        return 0;
+    }
+
+    fprintf(file, "{\n  \"repetitions\": %d,\n  \"warmup\": %d,\n  \"results\": [\n", suite->repetitions, suite->warmup);
+    for (int i = 0; i < suite->count; i++) {
+        const BenchResult* r = &suite->results[i];
+        fprintf(file, "    {\"name\": \"%s\", \"params\": \"%s\", \"iterations\": %ld, "
+                      "\"median_ns\": %.1f, \"p95_ns\": %.1f, \"items_per_us\": %.3f}%s\n",
+                r->name, r->params, r->iterations, r->medianNs, r->p95Ns,
+                r->items > 0 ? r->items / r->medianNs * 1e3 : 0.0, i + 1 < suite->count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) == 0;
+}
+
+// Deterministic fill so runs are comparable (xorshift32, values in [-1, 1))
+void fillRandom(float* values, long count, uint32_t seed) {
+    uint32_t state = seed ? seed : 1;
+    for (long i = 0; i < count; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        values[i] = (float)((state >> 8) * (2.0 / 16777216.0) - 1.0);
+    }
+}
+
+// Baseline: the int VLA kernel of cnn.c (convol), cnntrial.c and
+// final/conv.c (convolve), which are the same code under two names
+void legacyConvolveInt(int rowsA, int colsA, int A[rowsA][colsA],
+                       int rowsB, int colsB, int B[rowsB][colsB],
+                       int stride, int rowsC, int colsC, int C[rowsC][colsC]) {
+    for (int i = 0; i < rowsC; i++) {
+        for (int j = 0; j < colsC; j++) {
+            int sum = 0;
+            for (int m = 0; m < rowsB; m++) {
+                for (int n = 0; n < colsB; n++) {
+                    sum += A[i * stride + m][j * stride + n] * B[m][n];
+                }
+            }
+            C[i][j] = sum;
+        }
+    }
+}
+
+typedef struct {
+    Matrix* input;
+    Matrix* filter;
+    Matrix* bias;
+    int stride;
+    int poolCols;
+    Layer layer;
+    PackedLayer packed;
+    float* output;
+    int outputLength;
+    int* intInput;
+    int* intFilter;
+    int* intOutput;
+    int length;
+    int width;
+} KernelCase;
+
+void benchConvolve(void* arg) {
+    KernelCase* c = (KernelCase*)arg;
+    Matrix* output = convolve(c->input, c->filter, c->bias, c->stride);
+    benchSink = output->data[0][0];
+    freeMatrix(output);
+}
+
+void benchConvolveRow(void* arg) {
+    KernelCase* c = (KernelCase*)arg;
+    convolveRow(&c->layer, 0, c->input->data[0], c->output, c->outputLength, 1);
+    benchSink = c->output[0];
+}
+
+void benchConvolveBlock(void* arg) {
+    KernelCase* c = (KernelCase*)arg;
+    convolveBlock(&c->layer, &c->packed, 0, c->input->data[0], c->output, c->outputLength, 1);
+    benchSink = c->output[0];
+}
+
+void benchLegacyConvolve(void* arg) {
+    KernelCase* c = (KernelCase*)arg;
+    legacyConvolveInt(1, c->length, (int (*)[c->length])c->intInput, 1, c->width, (int (*)[c->width])c->intFilter,
+                      c->stride, 1, c->outputLength, (int (*)[c->outputLength])c->intOutput);
+    benchSink = (float)c->intOutput[0];
+}
+
+void benchMaxPool(void* arg) {
+    KernelCase* c = (KernelCase*)arg;
+    Matrix* output = maxPool(c->input, 1, c->poolCols, c->stride);
+    benchSink = output->data[0][0];
+    freeMatrix(output);
+}
+
+void benchMaxPoolRow(void* arg) {
+    KernelCase* c = (KernelCase*)arg;
+    maxPoolRow(c->input->data[0], c->poolCols, c->stride, c->output, c->outputLength);
+    benchSink = c->output[0];
+}
+
+void runConvolutionCases(BenchSuite* suite) {
+    static const int lengths[] = {256, 1800, 16384};
+    static const int widths[] = {3, 10, 32};
+    static const int strides[] = {1, 2, 4};
+
+    for (size_t li = 0; li < sizeof(lengths) / sizeof(lengths[0]); li++) {
+        for (size_t wi = 0; wi < sizeof(widths) / sizeof(widths[0]); wi++) {
+            for (size_t si = 0; si < sizeof(strides) / sizeof(strides[0]); si++) {
+                KernelCase c;
+                memset(&c, 0, sizeof(c));
+                c.length = lengths[li];
+                c.width = widths[wi];
+                c.stride = strides[si];
+                c.outputLength = (c.length - c.width) / c.stride + 1;
+
+                // PACK_WIDTH filters so convolveBlock does a full block; the
+                // other kernels apply the first one
+                c.input = createMatrix(1, c.length);
+                c.filter = createMatrix(PACK_WIDTH, c.width);
+                c.bias = createMatrix(PACK_WIDTH, 1);
+                fillRandom(c.input->data[0], c.length, 1);
+                for (int f = 0; f < PACK_WIDTH; f++) fillRandom(c.filter->data[f], c.width, 2 + f);
+                fillRandom(&c.bias->data[0][0], 1, 99);
+
+                c.layer.filters = c.filter;
+                c.layer.biases = c.bias;
+                c.layer.stride = c.stride;
+                c.layer.activation = ACTIVATION_LEAKY_RELU;
+                c.layer.alpha = 0.1f;
+                c.layer.scale = 1.0f;
+
+                Model model;
+                memset(&model, 0, sizeof(model));
+                model.numLayers = 1;
+                model.layers[0] = c.layer;
+                packModel(&model);
+                c.packed = model.packedLayers[0];
+
+                c.output = (float*)malloc((size_t)PACK_WIDTH * c.outputLength * sizeof(float));
+                c.intInput = (int*)malloc(c.length * sizeof(int));
+                c.intFilter = (int*)malloc(c.width * sizeof(int));
+                c.intOutput = (int*)malloc(c.outputLength * sizeof(int));
+                if (!c.output || !c.intInput || !c.intFilter || !c.intOutput) {
+                    fprintf(stderr, "Memory allocation failed for benchmark buffers\n");
+                    exit(EXIT_FAILURE);
+                }
+                for (int i = 0; i < c.length; i++) c.intInput[i] = (int)(c.input->data[0][i] * 1000);
+                for (int i = 0; i < c.width; i++) c.intFilter[i] = (int)(c.filter->data[0][i] * 1000);
+
+                // The filter matrix holds PACK_WIDTH rows, convolve() wants one
+                Matrix* single = createMatrixView(1, c.width, c.filter->data[0]);
+                Matrix* all = c.filter;
+                c.filter = single;
+
+                char params[64];
+                double taps = (double)c.outputLength * c.width;
+                snprintf(params, sizeof(params), "n=%d k=%d s=%d", c.length, c.width, c.stride);
+                runBenchmark(suite, "convolve", params, taps, benchConvolve, &c);
+                runBenchmark(suite, "convolveRow", params, taps, benchConvolveRow, &c);
+                runBenchmark(suite, "convolveBlock/8", params, taps * PACK_WIDTH, benchConvolveBlock, &c);
+                runBenchmark(suite, "legacy int convolve", params, taps, benchLegacyConvolve, &c);
+
+                freeMatrixView(single);
+                c.filter = all;
+                model.layers[0].filters = NULL;
+                free(model.packedLayers[0].weights);
+                free(model.packedLayers[0].biases);
+                free(c.output);
+                free(c.intInput);
+                free(c.intFilter);
+                free(c.intOutput);
+                freeMatrix(c.input);
+                freeMatrix(c.filter);
+                freeMatrix(c.bias);
+            }
+        }
+    }
+}
+
+void runPoolingCases(BenchSuite* suite) {
+    static const int lengths[] = {180, 896, 16384};
+    static const int windows[] = {1, 2, 5};
+    static const int strides[] = {1, 2, 5};
+
+    for (size_t li = 0; li < sizeof(lengths) / sizeof(lengths[0]); li++) {
+        for (size_t wi = 0; wi < sizeof(windows) / sizeof(windows[0]); wi++) {
+            for (size_t si = 0; si < sizeof(strides) / sizeof(strides[0]); si++) {
+                KernelCase c;
+                memset(&c, 0, sizeof(c));
+                c.length = lengths[li];
+                c.poolCols = windows[wi];
+                c.stride = strides[si];
+                c.outputLength = (c.length - c.poolCols) / c.stride + 1;
+                c.input = createMatrix(1, c.length);
+                fillRandom(c.input->data[0], c.length, 3);
+                c.output = (float*)malloc(c.outputLength * sizeof(float));
+                if (!c.output) {
+                    fprintf(stderr, "Memory allocation failed for benchmark buffers\n");
+                    exit(EXIT_FAILURE);
+                }
+
+                char params[64];
+                snprintf(params, sizeof(params), "n=%d w=%d s=%d", c.length, c.poolCols, c.stride);
+                runBenchmark(suite, "maxPool", params, c.outputLength, benchMaxPool, &c);
+                runBenchmark(suite, "maxPoolRow", params, c.outputLength, benchMaxPoolRow, &c);
+
+                free(c.output);
+                freeMatrix(c.input);
+            }
+        }
+    }
+}
+
+#define ACTIVATION_VALUES 4096
+
+typedef struct {
+    float values[ACTIVATION_VALUES];
+    Layer layer;
+} ActivationCase;
+
+void benchRelu(void* arg) {
+    ActivationCase* c = (ActivationCase*)arg;
+    float sum = 0;
+    for (int i = 0; i < ACTIVATION_VALUES; i++) sum += relu(c->values[i]);
+    benchSink = sum;
+}
+
+void benchLeakyRelu(void* arg) {
+    ActivationCase* c = (ActivationCase*)arg;
+    float sum = 0;
+    for (int i = 0; i < ACTIVATION_VALUES; i++) sum += leakyRelu(c->values[i]);
+    benchSink = sum;
+}
+
+void benchElu(void* arg) {
+    ActivationCase* c = (ActivationCase*)arg;
+    float sum = 0;
+    for (int i = 0; i < ACTIVATION_VALUES; i++) sum += elu(c->values[i], 1.0f);
+    benchSink = sum;
+}
+
+void benchSelu(void* arg) {
+    ActivationCase* c = (ActivationCase*)arg;
+    float sum = 0;
+    for (int i = 0; i < ACTIVATION_VALUES; i++) sum += selu(c->values[i], 1.6732632f, 1.0507010f);
+    benchSink = sum;
+}
+
+void benchApplyActivation(void* arg) {
+    ActivationCase* c = (ActivationCase*)arg;
+    float sum = 0;
+    for (int i = 0; i < ACTIVATION_VALUES; i++) sum += applyActivation(&c->layer, c->values[i]);
+    benchSink = sum;
+}
+
+void runActivationCases(BenchSuite* suite) {
+    ActivationCase c;
+    memset(&c, 0, sizeof(c));
+    fillRandom(c.values, ACTIVATION_VALUES, 4);
+    c.layer.activation = ACTIVATION_LEAKY_RELU;
+    c.layer.alpha = 0.1f;
+
+    char params[64];
+    snprintf(params, sizeof(params), "n=%d", ACTIVATION_VALUES);
+    runBenchmark(suite, "relu", params, ACTIVATION_VALUES, benchRelu, &c);
+    runBenchmark(suite, "leakyRelu", params, ACTIVATION_VALUES, benchLeakyRelu, &c);
+    runBenchmark(suite, "elu", params, ACTIVATION_VALUES, benchElu, &c);
+    runBenchmark(suite, "selu", params, ACTIVATION_VALUES, benchSelu, &c);
+    runBenchmark(suite, "applyActivation", params, ACTIVATION_VALUES, benchApplyActivation, &c);
+}
+
+typedef struct {
+    int rows;
+    int cols;
+} MatrixCase;
+
+void benchCreateFreeMatrix(void* arg) {
+    MatrixCase* c = (MatrixCase*)arg;
+    Matrix* matrix = createMatrix(c->rows, c->cols);
+    benchSink = matrix->data[0][0];
+    freeMatrix(matrix);
+}
+
+void runMatrixCases(BenchSuite* suite) {
+    // Shapes the network allocates: the input row, layer outputs, filters
+    static const MatrixCase shapes[] = {{1, 1800}, {1, 896}, {1, 18}, {16, 10}, {256, 1}, {1800, 1}};
+
+    for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+        MatrixCase c = shapes[i];
+        char params[64];
+        snprintf(params, sizeof(params), "%dx%d", c.rows, c.cols);
+        runBenchmark(suite, "createMatrix+free", params, 0, benchCreateFreeMatrix, &c);
+    }
+}
+
+typedef struct {
+    const char* path;
+    Matrix* (*reader)(const char*);
+} ReaderCase;
+
+void benchReader(void* arg) {
+    ReaderCase* c = (ReaderCase*)arg;
+    Matrix* matrix = c->reader(c->path);
+    if (matrix) {
+        benchSink = matrix->data[0][0];
+        freeMatrix(matrix);
+    }
+}
+
+// Writes rows x cols random values in the CSV layout the repository uses
+int writeRandomCSV(const char* path, int rows, int cols, uint32_t seed) {
+    FILE* file = fopen(path, "w");
+    if (!file) return 0;
+    float* values = (float*)malloc((size_t)rows * cols * sizeof(float));
+    if (!values) {
+        fprintf(stderr, "Memory allocation failed for benchmark CSV\n");
+        exit(EXIT_FAILURE);
+    }
+    fillRandom(values, (long)rows * cols, seed);
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < cols; c++) {
+            fprintf(file, "%.16f%s", values[(size_t)r * cols + c] * 0.2, c + 1 < cols ? "," : "\n");
+        }
+    }
+    free(values);
+    return fclose(file) == 0;
+}
+
+void runReaderCases(BenchSuite* suite) {
+    char directory[] = "/tmp/cnnbenchXXXXXX";
+    if (!mkdtemp(directory)) {
+        fprintf(stderr, "Could not create a temporary directory for reader benchmarks\n");
+        return;
+    }
+
+    // readMatrixFromCSV keeps at most 2000 values, so the signal files stay
+    // under that; the mapped reader also gets a large file
+    struct {
+        const char* name;
+        int rows;
+        int cols;
+    } files[] = {{"signal1800.csv", 1, 1800}, {"column1800.csv", 1800, 1}, {"filters16x10.csv", 16, 10},
+                 {"biases16.csv", 16, 1}, {"signal1m.csv", 1, 1 << 20}};
+    char paths[5][64];
+    for (int i = 0; i < 5; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "%s/%s", directory, files[i].name);
+        if (!writeRandomCSV(paths[i], files[i].rows, files[i].cols, 10 + i)) {
+            fprintf(stderr, "Could not write %s\n", paths[i]);
+            return;
+        }
+    }
+
+    ReaderCase cases[] = {
+        {paths[0], readMatrixFromCSV}, {paths[0], readMatrixFromCSVMapped},
+        {paths[1], readMatrixFromCSV}, {paths[1], readMatrixFromCSVMapped},
+        {paths[2], readFiltersFromCSV}, {paths[3], readBiasesFromCSV},
+        {paths[4], readMatrixFromCSVMapped}
+    };
+    const char* names[] = {
+        "readMatrixFromCSV", "readMatrixFromCSVMapped", "readMatrixFromCSV", "readMatrixFromCSVMapped",
+        "readFiltersFromCSV", "readBiasesFromCSV", "readMatrixFromCSVMapped"
+    };
+    const char* params[] = {"1x1800 row", "1x1800 row", "1800 lines", "1800 lines", "16x10", "16x1", "1x1048576 row"};
+    double values[] = {1800, 1800, 1800, 1800, 160, 16, 1 << 20};
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        runBenchmark(suite, names[i], params[i], values[i], benchReader, &cases[i]);
+    }
+
+    for (int i = 0; i < 5; i++) unlink(paths[i]);
+    rmdir(directory);
+}
+
+int main(int argc, char* argv[]) {
+    BenchSuite* suite = (BenchSuite*)calloc(1, sizeof(BenchSuite));
+    if (!suite) {
+        fprintf(stderr, "Memory allocation failed for benchmark suite\n");
+        return EXIT_FAILURE;
+    }
+    suite->repetitions = 31;
+    suite->warmup = 3;
+    const char* jsonFile = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+            suite->repetitions = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            suite->warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            suite->filter = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonFile = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--reps N] [--warmup N] [--filter text] [--json file]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (suite->repetitions <= 0 || suite->warmup < 0) {
+        fprintf(stderr, "Repetitions must be positive and warmup non-negative\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%-24s %-26s %12s %12s %10s\n", "benchmark", "parameters", "median ns", "p95 ns", "items/us");
+    runConvolutionCases(suite);
+    runPoolingCases(suite);
+    runActivationCases(suite);
+    runMatrixCases(suite);
+    runReaderCases(suite);
+
+    int status = EXIT_SUCCESS;
+    if (jsonFile && !writeBenchJSON(suite, jsonFile)) status = EXIT_FAILURE;
+    free(suite);
+    return status;
+}
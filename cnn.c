@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 
 
 void convol(int rowsA, int colsA, int A[rowsA][colsA], 
@@ -17,6 +18,81 @@ void convol(int rowsA, int colsA, int A[rowsA][colsA],
     }
 }
 
+int gcd(int a, int b) {
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Splits a rank-1 kernel into integers with B[m][n] == column[m] * row[n].
+// row is the first nonzero kernel row divided by the gcd of its entries, so
+// every other row must be an integer multiple of it. Returns 0 when the
+// kernel does not split exactly or two passes would not be cheaper.
+int separateKernel(int rowsB, int colsB, int B[rowsB][colsB], int column[rowsB], int row[colsB]) {
+    if (rowsB + colsB >= rowsB * colsB) return 0;
+
+    int pivot = -1;
+    int divisor = 0;
+    for (int m = 0; m < rowsB && pivot < 0; m++) {
+        for (int n = 0; n < colsB; n++) {
+            divisor = gcd(divisor, abs(B[m][n]));
+        }
+        if (divisor) pivot = m;
+    }
+    if (pivot < 0) return 0;
+
+    int lead = 0;
+    for (int n = 0; n < colsB; n++) {
+        row[n] = B[pivot][n] / divisor;
+        if (!row[lead]) lead = n;
+    }
+
+    for (int m = 0; m < rowsB; m++) {
+        if (B[m][lead] % row[lead]) return 0;
+        column[m] = B[m][lead] / row[lead];
+        for (int n = 0; n < colsB; n++) {
+            if ((long long)column[m] * row[n] != B[m][n]) return 0;
+        }
+    }
+    return 1;
+}
+
+// convol() for a kernel split by separateKernel(): a row pass over the input
+// rows the output reads, then a column pass. Gives the same integer sums.
+void convolSeparable(int rowsA, int colsA, int A[rowsA][colsA],
+              int rowsB, int column[rowsB], int colsB, int row[colsB],
+              int stride, int rowsC, int colsC, int C[rowsC][colsC]) {
+    int rowsT = (rowsC - 1) * stride + rowsB;
+    int (*T)[colsC] = malloc(rowsT * sizeof(*T));
+    if (!T) {
+        printf("Error: Could not allocate the row sums.\n");
+        exit(1);
+    }
+    for (int i = 0; i < rowsT; i++) {
+        for (int j = 0; j < colsC; j++) {
+            int sum = 0;
+            for (int n = 0; n < colsB; n++) {
+                sum += A[i][j * stride + n] * row[n];
+            }
+            T[i][j] = sum;
+        }
+    }
+
+    for (int i = 0; i < rowsC; i++) {
+        for (int j = 0; j < colsC; j++) {
+            int sum = 0;
+            for (int m = 0; m < rowsB; m++) {
+                sum += T[i * stride + m][j] * column[m];
+            }
+            C[i][j] = sum;
+        }
+    }
+    free(T);
+}
+
 int main() {
     int rowsA, colsA, rowsB, colsB, rowsD, colsD;
 
@@ -24,8 +100,14 @@ int main() {
     printf("Enter dimensions of Matrix A (rows and columns): ");
     scanf("%d %d", &rowsA, &colsA);
 
-    
-    int A[rowsA][colsA];
+    // The kernels are only read after A, so A is held whole; it and the
+    // results live on the heap rather than in stack VLAs that overflow on
+    // large images
+    int (*A)[colsA] = malloc(rowsA * sizeof(*A));
+    if (!A) {
+        printf("Error: Could not allocate Matrix A.\n");
+        return 1;
+    }
     printf("Enter elements of Matrix A:\n");
     for (int i = 0; i < rowsA; i++) {
         for (int j = 0; j < colsA; j++) {
@@ -51,6 +133,7 @@ int main() {
     int colsC = colsA - colsB + 1;
     if (rowsC <= 0 || colsC <= 0) {
         printf("Error: Kernel B size must be smaller than input matrix A dimensions.\n");
+        free(A);
         return 1;
     }
 
@@ -72,18 +155,35 @@ int main() {
     int colsE = colsA - colsD + 1;
     if (rowsE <= 0 || colsE <= 0) {
         printf("Error: Kernel D size must be smaller than input matrix A dimensions.\n");
+        free(A);
         return 1;
     }
 
-    
-    int C[rowsC][colsC];
-    int E[rowsE][colsE];
+    int (*C)[colsC] = malloc(rowsC * sizeof(*C));
+    int (*E)[colsE] = malloc(rowsE * sizeof(*E));
+    if (!C || !E) {
+        printf("Error: Could not allocate the result matrices.\n");
+        free(E);
+        free(C);
+        free(A);
+        return 1;
+    }
 
     
-    convol(rowsA, colsA, A, rowsB, colsB, B, rowsC, colsC, C);
+    // Both kernels run at stride 1, which rowsC and rowsE assume
+    int columnB[rowsB], rowB[colsB];
+    if (separateKernel(rowsB, colsB, B, columnB, rowB)) {
+        convolSeparable(rowsA, colsA, A, rowsB, columnB, colsB, rowB, 1, rowsC, colsC, C);
+    } else {
+        convol(rowsA, colsA, A, rowsB, colsB, B, 1, rowsC, colsC, C);
+    }
 
-    
-    convol(rowsA, colsA, A, rowsD, colsD, D, rowsE, colsE, E);
+    int columnD[rowsD], rowD[colsD];
+    if (separateKernel(rowsD, colsD, D, columnD, rowD)) {
+        convolSeparable(rowsA, colsA, A, rowsD, columnD, colsD, rowD, 1, rowsE, colsE, E);
+    } else {
+        convol(rowsA, colsA, A, rowsD, colsD, D, 1, rowsE, colsE, E);
+    }
 
     
     printf("Resultant Matrix after Convolution with Matrix B:\n");
@@ -102,5 +202,8 @@ int main() {
         printf("\n");
     }
 
+    free(E);
+    free(C);
+    free(A);
     return 0;
 }
\ No newline at end of file
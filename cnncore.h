@@ -0,0 +1,310 @@
+#ifndef CNNCORE_H
+#define CNNCORE_H
+
+// Model, kernels and workspace shared by libcnn.c and the 3rdlayer.c driver.
+// Programs embedding the network should use the stable API in libcnn.h
+// instead; these types may change between versions.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <stdatomic.h>
+
+typedef struct {
+    int rows;
+    int cols;
+    float** data;
+} Matrix;
+
+// Per-layer parameters of the filter chain network. Every filter of a layer is
+// applied to every pooled output of the previous layer.
+#define MAX_LAYERS 8
+
+typedef enum {
+    ACTIVATION_NONE = 0,
+    ACTIVATION_RELU = 1,
+    ACTIVATION_LEAKY_RELU = 2,
+    ACTIVATION_ELU = 3,
+    ACTIVATION_SELU = 4
+} ActivationType;
+
+typedef struct {
+    Matrix* filters;   // one filter per row
+    Matrix* biases;    // one bias per row
+    int stride;
+    int poolRows;
+    int poolCols;
+    int poolStride;
+    ActivationType activation;
+    float alpha;       // leaky slope for leaky relu, alpha for elu/selu
+    float scale;       // selu only
+    int activateAfterPool; // set by reorderPoolActivation(), never saved
+} Layer;
+
+// Output channels computed together by convolveBlock(); 8 floats fill one
+// AVX register (two SSE registers)
+#define PACK_WIDTH 8
+#define PACK_ALIGNMENT 64
+
+// A layer's filters reordered for convolveBlock(): filters are grouped into
+// blocks of PACK_WIDTH and each block is stored tap-major, so the
+// PACK_WIDTH weights for tap n of a block are contiguous:
+//
+//   weights[block][n][lane] = filter (block * PACK_WIDTH + lane), tap n
+//
+// Taps are padded with zeros up to a multiple of PACK_WIDTH and missing
+// filters in the last block are zero, so every block starts on a
+// PACK_ALIGNMENT boundary.
+typedef struct {
+    int numBlocks;
+    int filterLength;
+    int paddedLength;
+    float* weights;    // numBlocks * paddedLength * PACK_WIDTH
+    float* biases;     // numBlocks * PACK_WIDTH
+} PackedLayer;
+
+typedef struct {
+    int numLayers;
+    Layer layers[MAX_LAYERS];
+    void* mapping;     // binary model file when loaded with loadModelBinary()
+    size_t mappingSize;
+    int packed;        // packedLayers is filled in by packModel() or loadPackCache()
+    PackedLayer packedLayers[MAX_LAYERS];
+    void* packMapping; // pack cache file when loaded with loadPackCache()
+    size_t packMappingSize;
+} Model;
+
+// NumPy .npy tensor written through a shared mapping. The header is padded to
+// the size the widest signal count would need, so the shape can be rewritten
+// once the number of signals is known, and to a multiple of 64 bytes so data
+// starts aligned and consumers can open it with np.load(path, mmap_mode='r').
+typedef struct {
+    int fd;
+    char* mapping;
+    size_t mappedBytes;
+    size_t headerSize;
+    int ndim;
+    long shape[MAX_LAYERS + 2];
+    size_t signalFloats;   // floats per signal
+    int batched;           // leading signal dimension
+    long capacity;         // signals the file currently has room for
+    long signals;          // signals written
+} NpyFile;
+
+// Selected activations of one run, one NpyFile per layer and kind
+typedef struct {
+    NpyFile* conv[MAX_LAYERS];
+    NpyFile* pooled[MAX_LAYERS];
+    long signal;           // index of the signal being inferred
+} ActivationDump;
+
+// Per-layer performance counters from perf_event_open, counting the calling
+// thread in user space. Counters the kernel refuses (no PMU in a VM or
+// container, perf_event_paranoid) stay closed and are reported as n/a;
+// inference runs the same either way.
+typedef enum {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_L1D_MISSES,
+    COUNTER_LLC_MISSES,
+    COUNTER_BRANCH_MISSES,
+    COUNTER_TASK_CLOCK,    // nanoseconds, software counter
+    NUM_COUNTERS
+} CounterKind;
+
+typedef enum {
+    COUNTER_STEP_CONV,
+    COUNTER_STEP_POOL,
+    NUM_COUNTER_STEPS
+} CounterStep;
+
+typedef struct {
+    int leader;                  // group read fd, -1 if nothing opened
+    int fds[NUM_COUNTERS];
+    int slot[NUM_COUNTERS];      // position in a group read, -1 if unavailable
+    int numOpen;
+    uint64_t totals[MAX_LAYERS][NUM_COUNTER_STEPS][NUM_COUNTERS];
+    uint64_t outputs[MAX_LAYERS][NUM_COUNTER_STEPS];   // elements written
+    uint64_t overhead[NUM_COUNTERS];   // cost of one read, taken off every sample
+    int multiplexed;             // the group was not always on the PMU
+} LayerCounters;
+
+// Wall time per layer step over the inferences of a workspace, and the
+// analytic work behind it, for the roofline report
+typedef struct {
+    uint64_t nanoseconds[MAX_LAYERS][NUM_COUNTER_STEPS];
+    long inferences;
+} LayerProfile;
+
+typedef struct {
+    long calls;      // kernel invocations per inference
+    double flops;    // per inference
+    double bytes;    // read and written per inference
+} LayerWork;
+
+typedef struct {
+    double gflops;       // multiply-add probe
+    double cacheGBs;     // triad on cache-resident arrays
+    double memoryGBs;    // triad on arrays beyond the last-level cache
+} MachinePeaks;
+
+// Allocation accounting for matrices and workspace buffers, kept per thread.
+// Allocations made while a layer is set with setAllocationLayer() are also
+// charged to that layer. Frees on another thread than the allocation make
+// that thread's liveBytes go negative.
+typedef struct {
+    uint64_t allocations;
+    uint64_t frees;
+    uint64_t bytes;          // allocated, never decreases
+    int64_t liveBytes;       // allocated minus freed
+    int64_t peakBytes;       // high-water mark of liveBytes since the last reset
+    uint64_t layerAllocations[MAX_LAYERS];
+    uint64_t layerBytes[MAX_LAYERS];
+    int64_t layerPeakBytes[MAX_LAYERS];   // liveBytes high-water mark within the layer
+} AllocationStats;
+
+// Preallocated inference over flat row buffers. A Workspace holds every
+// intermediate buffer for one input length, so inferWorkspace() performs no
+// allocation and no I/O; outputs match convolve()/maxPool() exactly.
+typedef struct {
+    int inputLength;
+    int layerInputLength[MAX_LAYERS];
+    int convLength[MAX_LAYERS];
+    int poolLength[MAX_LAYERS];
+    float* conv[MAX_LAYERS];     // every filter of the layer, one row each
+    float* pooled[MAX_LAYERS];   // likewise, numFilters * poolLength
+    int numChains;
+    int outputLength;   // final pooled values per filter chain
+    ActivationDump* dump;   // optional, NULL unless dumping activations
+    LayerCounters* counters;   // optional, NULL unless counting
+    LayerProfile* profile;     // optional, NULL unless profiling
+} Workspace;
+
+// Matrices and CSV input
+Matrix* createMatrix(int rows, int cols);
+void freeMatrix(Matrix* matrix);
+Matrix* createMatrixView(int rows, int cols, float* data);
+void freeMatrixView(Matrix* matrix);
+Matrix* readMatrixFromCSV(const char* filename);
+Matrix* readFiltersFromCSV(const char* filename);
+Matrix* readBiasesFromCSV(const char* filename);
+Matrix* readMatrixFromCSVMapped(const char* filename);
+int isCSVDelimiter(char c);
+double parseDecimal(const char* start, const char* end, const char** next);
+void generateSignal(float* signal, int length, uint64_t seed, long index);
+
+// Layer-by-layer operations on whole matrices
+float relu(float x);
+float leakyRelu(float x);
+float selu(float x, float alpha, float scale);
+float elu(float x, float alpha);
+float applyActivation(const Layer* layer, float x);
+int isMonotonicActivation(const Layer* layer);
+int reorderPoolActivation(Model* model);
+Matrix* convolve(Matrix* input, Matrix* filter, Matrix* bias, int stride);
+Matrix* maxPool(Matrix* input, int poolRows, int poolCols, int stride);
+int inferReference(const Model* model, const float* input, int inputLength, float* output);
+
+// Models
+int loadModelFromCSV(Model* model, int numLayers, const char** filterFiles, const char** biasFiles,
+                     int stride, int poolRows, int poolCols, int poolStride);
+int saveModelBinary(const Model* model, const char* filename);
+int loadModelBinary(Model* model, const char* filename);
+void packModel(Model* model);
+void prepackModel(Model* model, const char* cacheModelFile);
+void freeModel(Model* model);
+
+// Preallocated inference
+void convolveRow(const Layer* layer, int f, const float* input, float* output, int outputLength, int activate);
+void convolveBlock(const Layer* layer, const PackedLayer* packed, int block, const float* input,
+                   float* output, int outputLength, int activate);
+void activateRow(const Layer* layer, int f, float* row, int length);
+void maxPoolRow(const float* input, int poolCols, int stride, float* output, int outputLength);
+Workspace* createWorkspace(const Model* model, int inputLength);
+void freeWorkspace(Workspace* ws, const Model* model);
+void inferWorkspace(const Model* model, Workspace* ws, const float* input, float* output);
+void inferBatch(const Model* model, Workspace* ws, const float* inputs, int count, float* outputs);
+
+// Depth-first tiling: the last layer's outputs are cut into tiles and each
+// tile runs through every layer from just the input range it depends on, so
+// intermediates live in tile-sized buffers. Ranges are half-open and index
+// full-length rows.
+typedef struct {
+    int inputBegin, inputEnd;
+    int convBegin, convEnd;
+    int poolBegin, poolEnd;
+} TileRange;
+
+typedef struct {
+    int tileLength;   // last-layer outputs per chain and tile
+    int numTiles;
+    int inputLength[MAX_LAYERS];   // of the largest tile, sizing the buffers
+    int convLength[MAX_LAYERS];
+    int poolLength[MAX_LAYERS];
+    long convComputed[MAX_LAYERS];   // conv values per filter over all tiles, halos included
+    float* conv[MAX_LAYERS];
+    float* pooled[MAX_LAYERS];
+} TileWorkspace;
+
+void computeTileRanges(const Model* model, int begin, int end, TileRange* ranges);
+TileWorkspace* createTileWorkspace(const Model* model, const Workspace* ws, int tileLength);
+void freeTileWorkspace(TileWorkspace* tw, const Model* model);
+int chooseTileLength(const Model* model, const Workspace* ws, long cacheBytes);
+void inferTiled(const Model* model, const Workspace* ws, TileWorkspace* tw, const float* input, float* output);
+void printTileTraffic(const Model* model, const Workspace* ws, const TileWorkspace* tw, long cacheBytes, FILE* out);
+
+// Activation dumps
+ActivationDump* createActivationDump(const char* dir, const char* selection, const Model* model,
+                                     const Workspace* ws, int batched);
+int reserveActivationDump(ActivationDump* dump, long count);
+void closeActivationDump(ActivationDump* dump);
+
+// Allocation accounting
+void recordAllocation(size_t bytes);
+void recordFree(size_t bytes);
+int setAllocationLayer(int layer);
+void getAllocationStats(AllocationStats* stats);
+void resetAllocationPeak(void);
+
+// Performance counters; attach to a Workspace to count its inferences
+LayerCounters* openLayerCounters(void);
+void readLayerCounters(LayerCounters* counters, uint64_t* values);
+void addLayerCounters(LayerCounters* counters, int layer, CounterStep step, const uint64_t* before, long outputs);
+void printLayerCounters(const LayerCounters* counters, const Model* model, FILE* file);
+void closeLayerCounters(LayerCounters* counters);
+
+// Roofline
+void estimateLayerWork(const Model* model, const Workspace* ws, int l, CounterStep step, LayerWork* work);
+void measureMachinePeaks(MachinePeaks* peaks);
+void printRoofline(const Model* model, const Workspace* ws, const LayerProfile* profile,
+                   const MachinePeaks* peaks, FILE* file);
+
+// Tracing. While tracing is on, spans are appended to a buffer owned by the
+// calling thread, stamped with the TSC (CLOCK_MONOTONIC where there is none).
+// While it is off a span costs one relaxed load and a predictable branch.
+// name must be a string literal; layer is -1 for spans outside a layer.
+typedef struct {
+    const char* name;
+    int layer;
+    uint64_t begin;
+    uint64_t end;
+} TraceEvent;
+
+extern atomic_int traceEnabled;
+
+uint64_t traceClock(void);
+long long traceNanoseconds(void);
+void traceRecord(const char* name, int layer, uint64_t begin);
+void startTracing(long eventsPerThread);
+void stopTracing(void);
+int writeChromeTrace(const char* filename);
+
+static inline uint64_t traceBegin(void) {
+    return atomic_load_explicit(&traceEnabled, memory_order_relaxed) ? traceClock() : 0;
+}
+
+static inline void traceEnd(const char* name, int layer, uint64_t begin) {
+    if (begin) traceRecord(name, layer, begin);
+}
+
+#endif
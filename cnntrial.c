@@ -2,22 +2,112 @@
 #include <stdlib.h>
 
 
-void convolve(int rowsA, int colsA, int A[rowsA][colsA], 
-              int rowsB, int colsB, int B[rowsB][colsB],
-              int stride, int rowsC, int colsC, int C[rowsC][colsC]) {
-    for (int i = 0; i < rowsC; i++) {
+int gcd(int a, int b) {
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Splits a rank-1 kernel into integers with B[m][n] == column[m] * row[n].
+// row is the first nonzero kernel row divided by the gcd of its entries, so
+// every other row must be an integer multiple of it. Returns 0 when the
+// kernel does not split exactly or two passes would not be cheaper.
+int separateKernel(int rowsB, int colsB, int B[rowsB][colsB], int column[rowsB], int row[colsB]) {
+    if (rowsB + colsB >= rowsB * colsB) return 0;
+
+    int pivot = -1;
+    int divisor = 0;
+    for (int m = 0; m < rowsB && pivot < 0; m++) {
+        for (int n = 0; n < colsB; n++) {
+            divisor = gcd(divisor, abs(B[m][n]));
+        }
+        if (divisor) pivot = m;
+    }
+    if (pivot < 0) return 0;
+
+    int lead = 0;
+    for (int n = 0; n < colsB; n++) {
+        row[n] = B[pivot][n] / divisor;
+        if (!row[lead]) lead = n;
+    }
+
+    for (int m = 0; m < rowsB; m++) {
+        if (B[m][lead] % row[lead]) return 0;
+        column[m] = B[m][lead] / row[lead];
+        for (int n = 0; n < colsB; n++) {
+            if ((long long)column[m] * row[n] != B[m][n]) return 0;
+        }
+    }
+    return 1;
+}
+
+// Streams A from file a row at a time, keeping only the last rowsB rows in a
+// ring (row r in slot r % rowsB), and prints each row of C as soon as its
+// last input row is read, so memory is O(rowsB * colsA) however tall A is.
+// With a kernel split by separateKernel() the ring keeps each input row's
+// row-pass sums instead and the column pass runs over them. Returns 0 if
+// the file runs out before rowsA rows.
+int convolveStream(FILE* file, int rowsA, int colsA, int rowsB, int colsB, int B[rowsB][colsB],
+                   int separable, int column[rowsB], int row[colsB], int stride, int colsC) {
+    int width = separable ? colsC : colsA;
+    int* input = malloc(colsA * sizeof(int));
+    int (*ring)[width] = malloc(rowsB * sizeof(*ring));
+    if (!input || !ring) {
+        printf("Error: Could not allocate row buffers\n");
+        exit(1);
+    }
+
+    int complete = 1;
+    for (int r = 0; r < rowsA && complete; r++) {
+        for (int j = 0; j < colsA; j++) {
+            if (fscanf(file, "%d", &input[j]) != 1) {
+                printf("Error: Input ended after %d of %d rows\n", r, rowsA);
+                complete = 0;
+                break;
+            }
+        }
+        if (!complete) break;
+
+        int* slot = ring[r % rowsB];
+        for (int j = 0; j < width; j++) {
+            if (separable) {
+                int sum = 0;
+                for (int n = 0; n < colsB; n++) {
+                    sum += input[j * stride + n] * row[n];
+                }
+                slot[j] = sum;
+            } else {
+                slot[j] = input[j];
+            }
+        }
+
+        // Row i of C reads rows i * stride to i * stride + rowsB - 1 of A
+        int top = r - rowsB + 1;
+        if (top < 0 || top % stride != 0) continue;
         for (int j = 0; j < colsC; j++) {
             int sum = 0;
             for (int m = 0; m < rowsB; m++) {
-                for (int n = 0; n < colsB; n++) {
-                    sum += A[i * stride + m][j * stride + n] * B[m][n];
+                int* inputRow = ring[(top + m) % rowsB];
+                if (separable) {
+                    sum += inputRow[j] * column[m];
+                } else {
+                    for (int n = 0; n < colsB; n++) {
+                        sum += inputRow[j * stride + n] * B[m][n];
+                    }
                 }
             }
-            C[i][j] = sum;
+            printf("%d ", sum);
         }
+        printf("\n");
     }
-}
 
+    free(ring);
+    free(input);
+    return complete;
+}
 
 void readMatrixFromFile(const char* filename, int rows, int cols, int matrix[rows][cols]) {
     FILE *file = fopen(filename, "r");
@@ -43,11 +133,6 @@ int main() {
     printf("Enter stride value: ");
     scanf("%d", &stride);
 
-    int A[rowsA][colsA];
-    readMatrixFromFile("input_matrix.txt", rowsA, colsA, A);
-    printf("Input Matrix A read from file.\n");
-
-    
     printf("Enter dimensions of Matrix B (rows and columns): ");
     scanf("%d %d", &rowsB, &colsB);
 
@@ -64,16 +149,19 @@ int main() {
         return 1;
     }
 
-    int C[rowsC][colsC];
-    convolve(rowsA, colsA, A, rowsB, colsB, B, stride, rowsC, colsC, C);
+    // A is never held whole: its rows stream through a rowsB-row ring
+    FILE* file = fopen("input_matrix.txt", "r");
+    if (!file) {
+        printf("Error: Could not open file %s\n", "input_matrix.txt");
+        return 1;
+    }
 
+    int column[rowsB], row[colsB];
+    int separable = separateKernel(rowsB, colsB, B, column, row);
     printf("Resultant Matrix after Convolution with Matrix B:\n");
-    for (int i = 0; i < rowsC; i++) {
-        for (int j = 0; j < colsC; j++) {
-            printf("%d ", C[i][j]);
-        }
-        printf("\n");
-    }
+    int complete = convolveStream(file, rowsA, colsA, rowsB, colsB, B, separable, column, row, stride, colsC);
+    fclose(file);
+    if (!complete) return 1;
 
     
 
@@ -0,0 +1,343 @@
+// End-to-end throughput and latency benchmark for the full network, driven
+// through the libcnn.h engine API on deterministic synthetic signals. Build with
+//
+//   gcc -O2 -o e2ebench e2ebench.c libcnn.c -lm -lpthread
+//
+//   e2ebench [--model file] [--signals N] [--length N] [--seed N] [--batch N]
+//            [--threads N] [--mode single|batch|threads|reference|all] [--write-csv file]
+//            [--trace file]
+//
+// Without --model the CSV weights in the current directory are used, with the
+// same configuration as 3rdlayer. Every signal is generated from the seed and
+// its own index, so a given seed always produces the same set regardless of
+// the mode or thread count. --write-csv saves the signals one per line for use
+// with 3rdlayer --batch. The reference mode runs the original allocating
+// convolve/maxPool pipeline one signal at a time; every mode also reports the
+// library's allocations per signal and the peak live bytes of one inference,
+// per layer where the allocations can be attributed. --trace records the run as Chrome trace-event JSON;
+// expect lower throughput while tracing.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include "cnncore.h"
+#include "libcnn.h"
+
+long long nowNanoseconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int compareLongLong(const void* a, const void* b) {
+    long long x = *(const long long*)a;
+    long long y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+long peakResidentKilobytes(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return -1;
+    return usage.ru_maxrss;
+}
+
+typedef struct {
+    CnnEngine* engine;
+    const float* signals;
+    int length;
+    long outputSize;
+    long first;           // signals [first, last) belong to this worker
+    long last;
+    int batch;
+    int reference;        // use cnnEngineInferReference, one signal per call
+    long long* latencies; // one per call, indexed from first / batch
+    pthread_barrier_t* start;
+    int status;
+    CnnAllocationStats allocations;   // counts over the run, peaks of the worst call
+} BenchWorker;
+
+// Folds the allocations of one call, measured from before (taken after a peak
+// reset) to after, into total
+void addCallAllocations(CnnAllocationStats* total, const CnnAllocationStats* before, const CnnAllocationStats* after) {
+    total->allocations += after->allocations - before->allocations;
+    total->frees += after->frees - before->frees;
+    total->bytes += after->bytes - before->bytes;
+    if (after->peakBytes - before->liveBytes > total->peakBytes) {
+        total->peakBytes = after->peakBytes - before->liveBytes;
+    }
+    for (int l = 0; l < CNN_MAX_LAYERS; l++) {
+        total->layerAllocations[l] += after->layerAllocations[l] - before->layerAllocations[l];
+        total->layerBytes[l] += after->layerBytes[l] - before->layerBytes[l];
+        if (after->layerPeakBytes[l] - before->liveBytes > total->layerPeakBytes[l]) {
+            total->layerPeakBytes[l] = after->layerPeakBytes[l] - before->liveBytes;
+        }
+    }
+}
+
+void* runWorker(void* arg) {
+    BenchWorker* worker = (BenchWorker*)arg;
+    CnnContext* context = cnnContextCreate(worker->engine, worker->length);
+    float* output = context ? (float*)malloc((size_t)worker->batch * worker->outputSize * sizeof(float)) : NULL;
+    if (context && !output) {
+        fprintf(stderr, "Memory allocation failed for benchmark output\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Untimed first call so page faults in the workspace are not measured
+    if (context) cnnContextInfer(context, worker->signals + worker->first * worker->length, output, worker->outputSize);
+
+    pthread_barrier_wait(worker->start);
+    if (!context) {
+        worker->status = CNN_ERROR_INPUT_LENGTH;
+        return NULL;
+    }
+
+    long call = 0;
+    for (long i = worker->first; i < worker->last; i += worker->batch) {
+        int count = worker->last - i < worker->batch ? (int)(worker->last - i) : worker->batch;
+        const float* input = worker->signals + i * worker->length;
+        size_t capacity = (size_t)count * worker->outputSize;
+        CnnAllocationStats before;
+        CnnAllocationStats after;
+        cnnResetAllocationPeak();
+        cnnGetAllocationStats(&before);
+
+        long long start = nowNanoseconds();
+        int status;
+        if (worker->reference) {
+            status = cnnEngineInferReference(worker->engine, input, worker->length, output, capacity);
+        } else if (count == 1) {
+            status = cnnContextInfer(context, input, output, capacity);
+        } else {
+            status = cnnContextInferBatch(context, input, count, output, capacity);
+        }
+        worker->latencies[call++] = nowNanoseconds() - start;
+
+        cnnGetAllocationStats(&after);
+        addCallAllocations(&worker->allocations, &before, &after);
+        if (status != CNN_OK) {
+            worker->status = status;
+            break;
+        }
+    }
+
+    free(output);
+    cnnContextFree(context);
+    return NULL;
+}
+
+// Runs all signals split evenly over threads, batch signals per call, and
+// prints one row of the report
+int runMode(const char* name, CnnEngine* engine, const float* signals, long count, int length,
+            long outputSize, int threads, int batch, int reference) {
+    if (threads > count) threads = (int)count;
+
+    BenchWorker* workers = (BenchWorker*)calloc(threads, sizeof(BenchWorker));
+    pthread_t* ids = (pthread_t*)malloc(threads * sizeof(pthread_t));
+    long long* latencies = (long long*)malloc((count + threads) * sizeof(long long));
+    if (!workers || !ids || !latencies) {
+        fprintf(stderr, "Memory allocation failed for benchmark workers\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, threads + 1);
+
+    long calls = 0;
+    for (int t = 0; t < threads; t++) {
+        BenchWorker* worker = &workers[t];
+        worker->engine = engine;
+        worker->signals = signals;
+        worker->length = length;
+        worker->outputSize = outputSize;
+        worker->first = count * t / threads;
+        worker->last = count * (t + 1) / threads;
+        worker->batch = batch;
+        worker->reference = reference;
+        worker->latencies = latencies + calls;
+        worker->start = &start;
+        calls += (worker->last - worker->first + batch - 1) / batch;
+        if (pthread_create(&ids[t], NULL, runWorker, worker) != 0) {
+            fprintf(stderr, "Failed to start benchmark thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    pthread_barrier_wait(&start);
+    long long began = nowNanoseconds();
+    for (int t = 0; t < threads; t++) pthread_join(ids[t], NULL);
+    double seconds = (nowNanoseconds() - began) / 1e9;
+    pthread_barrier_destroy(&start);
+
+    int status = CNN_OK;
+    CnnAllocationStats allocations;
+    memset(&allocations, 0, sizeof(allocations));
+    for (int t = 0; t < threads; t++) {
+        if (workers[t].status != CNN_OK) status = workers[t].status;
+        const CnnAllocationStats* w = &workers[t].allocations;
+        allocations.allocations += w->allocations;
+        allocations.bytes += w->bytes;
+        if (w->peakBytes > allocations.peakBytes) allocations.peakBytes = w->peakBytes;
+        for (int l = 0; l < CNN_MAX_LAYERS; l++) {
+            allocations.layerAllocations[l] += w->layerAllocations[l];
+            allocations.layerBytes[l] += w->layerBytes[l];
+            if (w->layerPeakBytes[l] > allocations.layerPeakBytes[l]) {
+                allocations.layerPeakBytes[l] = w->layerPeakBytes[l];
+            }
+        }
+    }
+
+    if (status == CNN_OK) {
+        qsort(latencies, calls, sizeof(long long), compareLongLong);
+        printf("%-9s %7d %6d %9ld %9.3f %12.1f %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", name, threads,
+               batch, count, seconds, count / seconds, latencies[calls / 2] / 1e3,
+               latencies[(long)(calls * 0.99)] / 1e3, latencies[(long)(calls * 0.999)] / 1e3,
+               peakResidentKilobytes() / 1024.0, (double)allocations.allocations / count,
+               allocations.bytes / 1024.0 / count, allocations.peakBytes / 1024.0);
+        for (int l = 0; l < CNN_MAX_LAYERS; l++) {
+            if (!allocations.layerAllocations[l]) continue;
+            printf("  layer %d: %.1f allocs/signal, %.1f KB/signal, peak %.1f KB live\n", l + 1,
+                   (double)allocations.layerAllocations[l] / count, allocations.layerBytes[l] / 1024.0 / count,
+                   allocations.layerPeakBytes[l] / 1024.0);
+        }
+    } else {
+        fprintf(stderr, "%s: inference failed with status %d\n", name, status);
+    }
+
+    free(latencies);
+    free(ids);
+    free(workers);
+    return status == CNN_OK;
+}
+
+int writeSignalsCSV(const char* filename, const float* signals, long count, int length) {
+    FILE* file = fopen(filename, "w");
+    if (!file) {
+        fprintf(stderr, "Error opening file: %s\n", filename);
+        return 0;
+    }
+    for (long s = 0; s < count; s++) {
+        const float* signal = signals + s * length;
+        for (int i = 0; i < length; i++) {
+            fprintf(file, i ? ",%.9g" : "%.9g", signal[i]);
+        }
+        fputc('\n', file);
+    }
+    return fclose(file) == 0;
+}
+
+int main(int argc, char* argv[]) {
+    const char* filterFiles[3] = {
+        "CNN_layer_1_filter_weights.csv",
+        "CNN_layer_2_filter_weights.csv",
+        "CNN_layer_3_filter_weights.csv"
+    };
+    const char* biasFiles[3] = {
+        "CNN_layer_1_filter_bias.csv",
+        "CNN_layer_2_filter_bias.csv",
+        "CNN_layer_3_filter_bias.csv"
+    };
+
+    const char* modelFile = NULL;
+    const char* csvFile = NULL;
+    const char* traceFile = NULL;
+    const char* mode = "all";
+    long count = 2000;
+    int length = 1800;
+    unsigned long long seed = 1;
+    int batch = 32;
+    int threads = 4;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
+            modelFile = argv[++i];
+        } else if (strcmp(argv[i], "--signals") == 0 && i + 1 < argc) {
+            count = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--length") == 0 && i + 1 < argc) {
+            length = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc) {
+            mode = argv[++i];
+        } else if (strcmp(argv[i], "--write-csv") == 0 && i + 1 < argc) {
+            csvFile = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            traceFile = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--model file] [--signals N] [--length N] [--seed N] [--batch N] "
+                            "[--threads N] [--mode single|batch|threads|reference|all] [--write-csv file] [--trace file]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    int runSingle = strcmp(mode, "single") == 0 || strcmp(mode, "all") == 0;
+    int runBatch = strcmp(mode, "batch") == 0 || strcmp(mode, "all") == 0;
+    int runThreads = strcmp(mode, "threads") == 0 || strcmp(mode, "all") == 0;
+    int runReference = strcmp(mode, "reference") == 0 || strcmp(mode, "all") == 0;
+    if (count <= 0 || length <= 0 || batch <= 0 || threads <= 0
+        || !(runSingle || runBatch || runThreads || runReference)) {
+        fprintf(stderr, "Signals, length, batch and threads must be positive and mode one of single, batch, "
+                        "threads, reference, all\n");
+        return EXIT_FAILURE;
+    }
+
+    if (traceFile) cnnTraceStart(1 << 20);
+    CnnEngine* engine = modelFile ? cnnEngineOpen(modelFile)
+                                  : cnnEngineOpenCSV(3, filterFiles, biasFiles, 2, 5, 1, 5);
+    if (!engine) {
+        fprintf(stderr, "Failed to load the model\n");
+        return EXIT_FAILURE;
+    }
+    long outputSize = cnnEngineOutputSize(engine, length);
+    if (outputSize < 0) {
+        fprintf(stderr, "The model cannot take signals of %d samples\n", length);
+        cnnEngineFree(engine);
+        return EXIT_FAILURE;
+    }
+
+    float* signals = (float*)malloc((size_t)count * length * sizeof(float));
+    if (!signals) {
+        fprintf(stderr, "Memory allocation failed for %ld signals\n", count);
+        exit(EXIT_FAILURE);
+    }
+    for (long s = 0; s < count; s++) generateSignal(signals + s * length, length, seed, s);
+
+    int status = EXIT_SUCCESS;
+    if (csvFile && !writeSignalsCSV(csvFile, signals, count, length)) status = EXIT_FAILURE;
+
+    printf("%ld signals of %d samples, seed %llu, %ld outputs each\n", count, length, seed, outputSize);
+    printf("peak RSS after generation %.1f MB; latencies are per call (one call per signal, or per batch)\n\n",
+           peakResidentKilobytes() / 1024.0);
+    printf("%-9s %7s %6s %9s %9s %12s %10s %10s %10s %10s %10s %10s %10s\n", "mode", "threads", "batch", "signals",
+           "seconds", "signals/s", "p50 us", "p99 us", "p99.9 us", "peak MB", "allocs/sig", "KB/sig", "peak KB");
+
+    if (runSingle && !runMode("single", engine, signals, count, length, outputSize, 1, 1, 0)) {
+        status = EXIT_FAILURE;
+    }
+    if (runBatch && !runMode("batch", engine, signals, count, length, outputSize, 1, batch, 0)) {
+        status = EXIT_FAILURE;
+    }
+    if (runThreads && !runMode("threads", engine, signals, count, length, outputSize, threads, 1, 0)) {
+        status = EXIT_FAILURE;
+    }
+    if (runReference && !runMode("reference", engine, signals, count, length, outputSize, 1, 1, 1)) {
+        status = EXIT_FAILURE;
+    }
+
+    if (traceFile) {
+        cnnTraceStop();
+        if (cnnTraceWrite(traceFile) != CNN_OK) status = EXIT_FAILURE;
+    }
+
+    free(signals);
+    cnnEngineFree(engine);
+    return status;
+}
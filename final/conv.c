@@ -1,90 +1,189 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
 
-void convolve(int rowsA, int colsA, int A[rowsA][colsA], 
-              int rowsB, int colsB, int B[rowsB][colsB],
-              int stride, int rowsC, int colsC, int C[rowsC][colsC]) {
-    for (int i = 0; i < rowsC; i++) {
-        for (int j = 0; j < colsC; j++) {
-            int sum = 0;
-            for (int m = 0; m < rowsB; m++) {
-                for (int n = 0; n < colsB; n++) {
-                    sum += A[i * stride + m][j * stride + n] * B[m][n];
-                }
+// Parses one line of integers separated by commas and/or whitespace into
+// values, growing it as needed. Returns the number of values, or -1 at end of
+// input.
+int readRow(FILE* file, char** line, size_t* lineSize, int** values, int* capacity) {
+    if (getline(line, lineSize, file) < 0) return -1;
+
+    int count = 0;
+    char* p = *line;
+    while (*p) {
+        while (*p && (isspace((unsigned char)*p) || *p == ',')) p++;
+        if (!*p) break;
+        char* end;
+        long value = strtol(p, &end, 10);
+        if (end == p) {
+            p++;
+            continue;
+        }
+        if (count == *capacity) {
+            *capacity = *capacity ? *capacity * 2 : 64;
+            *values = (int*)realloc(*values, *capacity * sizeof(int));
+            if (!*values) {
+                fprintf(stderr, "Memory allocation failed for input row\n");
+                exit(EXIT_FAILURE);
             }
-            C[i][j] = sum;
         }
+        (*values)[count++] = (int)value;
+        p = end;
     }
+    return count;
 }
 
-void readMatrixFromFile(const char* filename, int rows, int cols, int matrix[rows][cols]) {
-    FILE *file = fopen(filename, "r");
+// Reads a kernel whose shape is given by the file itself: one kernel row per
+// nonblank line. Returns NULL if the file is missing, empty or ragged.
+int* readKernel(const char* filename, int* rows, int* cols) {
+    FILE* file = fopen(filename, "r");
     if (!file) {
         printf("Error: Could not open file %s\n", filename);
-        exit(1);
+        return NULL;
     }
-    for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < cols; j++) {
-            fscanf(file, "%d", &matrix[i][j]);
+
+    char* line = NULL;
+    size_t lineSize = 0;
+    int* values = NULL;
+    int capacity = 0;
+    int* kernel = NULL;
+    int count;
+    *rows = 0;
+    *cols = 0;
+    while ((count = readRow(file, &line, &lineSize, &values, &capacity)) >= 0) {
+        if (count == 0) continue;
+        if (*rows > 0 && count != *cols) {
+            printf("Error: Kernel rows in %s differ in length\n", filename);
+            free(kernel);
+            kernel = NULL;
+            *rows = 0;
+            break;
         }
+        *cols = count;
+        kernel = (int*)realloc(kernel, (size_t)(*rows + 1) * count * sizeof(int));
+        if (!kernel) {
+            fprintf(stderr, "Memory allocation failed for kernel\n");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(kernel + (size_t)*rows * count, values, count * sizeof(int));
+        (*rows)++;
     }
+
+    free(values);
+    free(line);
     fclose(file);
+    if (*rows == 0) {
+        free(kernel);
+        return NULL;
+    }
+    return kernel;
 }
 
-void inferMatrixDimensions(const char* filename, int* rows, int* cols, int* numFilters) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        printf("Error: Could not open file %s\n", filename);
-        exit(1);
-    }
-    char ch;
-    *cols = 0; *rows = 0; 
-    int tempRows = 0;
-    while ((ch = fgetc(file)) != EOF) {
-        if (ch == ',') {
-            if (tempRows == 0) (*cols)++;
-        } else if (ch == '\n') {
-            (*rows)++;
-            tempRows = 1;
+// Convolves an image streamed row by row from file with a rowsB x colsB
+// kernel. Only the last rowsB input rows are kept, in a ring indexed by row
+// number modulo rowsB, and each output row is printed as soon as its last
+// input row arrives, so memory is O(rowsB * width) whatever the height.
+// Rows that no output reads (stride above rowsB) are parsed and dropped.
+int convolveStream(FILE* file, int rowsB, int colsB, const int* B, int stride) {
+    char* line = NULL;
+    size_t lineSize = 0;
+    int* values = NULL;
+    int capacity = 0;
+    int* ring = NULL;
+    int* output = NULL;
+    int colsA = 0, colsC = 0, rowsC = 0;
+    int status = 0;
+    int count;
+
+    for (int r = 0; (count = readRow(file, &line, &lineSize, &values, &capacity)) >= 0;) {
+        if (count == 0) continue;
+        if (r == 0) {
+            colsA = count;
+            colsC = ((colsA - colsB) / stride) + 1;
+            if (colsA < colsB) {
+                printf("Error: Kernel B size must be smaller than input matrix A dimensions.\n");
+                status = 1;
+                break;
+            }
+            ring = (int*)malloc((size_t)rowsB * colsA * sizeof(int));
+            output = (int*)malloc(colsC * sizeof(int));
+            if (!ring || !output) {
+                fprintf(stderr, "Memory allocation failed for row buffers\n");
+                exit(EXIT_FAILURE);
+            }
+        } else if (count != colsA) {
+            printf("Error: Input row %d has %d values, expected %d\n", r + 1, count, colsA);
+            status = 1;
+            break;
         }
+        memcpy(ring + (size_t)(r % rowsB) * colsA, values, colsA * sizeof(int));
+
+        // Output row i reads input rows i * stride to i * stride + rowsB - 1
+        int first = r - rowsB + 1;
+        if (first >= 0 && first % stride == 0) {
+            for (int j = 0; j < colsC; j++) {
+                int sum = 0;
+                for (int m = 0; m < rowsB; m++) {
+                    const int* inputRow = ring + (size_t)((first + m) % rowsB) * colsA;
+                    for (int n = 0; n < colsB; n++) {
+                        sum += inputRow[j * stride + n] * B[m * colsB + n];
+                    }
+                }
+                output[j] = sum;
+            }
+
+            if (rowsC++ == 0) printf("Resultant Matrix after Convolution with Matrix B:\n");
+            for (int j = 0; j < colsC; j++) {
+                printf("%d ", output[j]);
+            }
+            printf("\n");
+        }
+        r++;
     }
-    (*cols)++;
-    *numFilters = *rows / *cols;
-    fclose(file);
-}
 
-int main() {
-    int rowsA, colsA, rowsB, colsB, rowsC, colsC, numFilters, stride;
-    printf("Enter stride value: ");
-    scanf("%d", &stride);
+    if (!status && rowsC == 0) {
+        printf("Error: Kernel B size must be smaller than input matrix A dimensions.\n");
+        status = 1;
+    }
 
-    inferMatrixDimensions("input_matrix.txt", &rowsA, &colsA, &numFilters);
-    int A[rowsA][colsA];
-    readMatrixFromFile("input_matrix.txt", rowsA, colsA, A);
-    printf("Input Matrix A read from file.\n");
+    free(output);
+    free(ring);
+    free(values);
+    free(line);
+    return status;
+}
 
-    rowsB = colsA;
-    colsB = colsA;
-    int B[rowsB][colsB];
-    readMatrixFromFile("filter_matrix.txt", rowsB, colsB, B);
-    printf("Filter Matrix B read from file.\n");
+// conv [input file|-] [kernel file]: the input defaults to input_matrix.txt
+// and - reads it from stdin after the stride
+int main(int argc, char* argv[]) {
+    const char* inputFile = argc > 1 ? argv[1] : "input_matrix.txt";
+    const char* kernelFile = argc > 2 ? argv[2] : "filter_matrix.txt";
+    int rowsB, colsB, stride;
 
-    rowsC = ((rowsA - rowsB) / stride) + 1;
-    colsC = ((colsA - colsB) / stride) + 1;
-    if (rowsC <= 0 || colsC <= 0) {
-        printf("Error: Kernel B size must be smaller than input matrix A dimensions.\n");
+    printf("Enter stride value: ");
+    if (scanf("%d", &stride) != 1 || stride <= 0) {
+        printf("Error: Invalid stride value\n");
         return 1;
     }
 
-    int C[rowsC][colsC];
-    convolve(rowsA, colsA, A, rowsB, colsB, B, stride, rowsC, colsC, C);
+    int* B = readKernel(kernelFile, &rowsB, &colsB);
+    if (!B) return 1;
+    printf("Filter Matrix B read from file.\n");
 
-    printf("Resultant Matrix after Convolution with Matrix B:\n");
-    for (int i = 0; i < rowsC; i++) {
-        for (int j = 0; j < colsC; j++) {
-            printf("%d ", C[i][j]);
+    FILE* file = stdin;
+    if (strcmp(inputFile, "-") != 0) {
+        file = fopen(inputFile, "r");
+        if (!file) {
+            printf("Error: Could not open file %s\n", inputFile);
+            free(B);
+            return 1;
         }
-        printf("\n");
     }
-    return 0;
+
+    int status = convolveStream(file, rowsB, colsB, B, stride);
+
+    if (file != stdin) fclose(file);
+    free(B);
+    return status;
 }
@@ -61,7 +61,9 @@ Matrix* readMatrixFromCSV(const char* filename) {
     int rows = 0, cols = 0;
     char line[4096];
     
+    // Blank lines are skipped here and below, as readStreamRow() does
     while (fgets(line, sizeof(line), file)) {
+        if (strspn(line, " \t\r\n") == strlen(line)) continue;
         rows++;
         
         if (rows == 1) {
@@ -70,7 +72,6 @@ Matrix* readMatrixFromCSV(const char* filename) {
                 cols++;
                 token = strtok(NULL, ",");
             }
-            rewind(file);
         }
     }
 
@@ -79,6 +80,10 @@ Matrix* readMatrixFromCSV(const char* filename) {
     rewind(file);
     for (int i = 0; i < rows; i++) {
         if (!fgets(line, sizeof(line), file)) break;
+        if (strspn(line, " \t\r\n") == strlen(line)) {
+            i--;
+            continue;
+        }
         
         char* token = strtok(line, ",");
         for (int j = 0; j < cols && token; j++) {
@@ -95,7 +100,7 @@ Matrix* convolve(Matrix* input, Matrix* filter, int stride) {
     int outputRows = ((input->rows - filter->rows) / stride) + 1;
     int outputCols = ((input->cols - filter->cols) / stride) + 1;
 
-    if (outputRows <= 0 || outputCols <= 0) {
+    if (input->rows < filter->rows || input->cols < filter->cols || outputRows <= 0 || outputCols <= 0) {
         fprintf(stderr, "Invalid convolution dimensions\n");
         return NULL;
     }
@@ -117,6 +122,361 @@ Matrix* convolve(Matrix* input, Matrix* filter, int stride) {
     return output;
 }
 
+int gcd(int a, int b) {
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Splits a rank-1 filter into integers with filter[m][n] == column[m] * row[n].
+// row is the first nonzero filter row divided by the gcd of its entries, so
+// no integer divides all of it and every other row must be an integer
+// multiple of it. Returns 0 when the filter does not split exactly, or when
+// a row pass plus a column pass (rows + cols multiplies per output) would
+// not beat the direct rows * cols.
+int separateFilter(Matrix* filter, int* column, int* row) {
+    int rows = filter->rows;
+    int cols = filter->cols;
+    if (rows + cols >= rows * cols) return 0;
+
+    int pivot = -1;
+    int divisor = 0;
+    for (int m = 0; m < rows && pivot < 0; m++) {
+        for (int n = 0; n < cols; n++) {
+            divisor = gcd(divisor, abs(filter->data[m][n]));
+        }
+        if (divisor) pivot = m;
+    }
+    if (pivot < 0) return 0;
+
+    int lead = 0;
+    for (int n = 0; n < cols; n++) {
+        row[n] = filter->data[pivot][n] / divisor;
+        if (!row[lead]) lead = n;
+    }
+
+    for (int m = 0; m < rows; m++) {
+        if (filter->data[m][lead] % row[lead]) return 0;
+        column[m] = filter->data[m][lead] / row[lead];
+        for (int n = 0; n < cols; n++) {
+            if ((long long)column[m] * row[n] != filter->data[m][n]) return 0;
+        }
+    }
+
+    return 1;
+}
+
+// convolve() for a filter split by separateFilter(): a row pass over every
+// input row the output reads, then a column pass over the row sums. Integer
+// sums regroup exactly, so the output matches convolve().
+Matrix* convolveSeparable(Matrix* input, int filterRows, const int* column, int filterCols, const int* row,
+                          int stride) {
+    int outputRows = ((input->rows - filterRows) / stride) + 1;
+    int outputCols = ((input->cols - filterCols) / stride) + 1;
+
+    if (input->rows < filterRows || input->cols < filterCols || outputRows <= 0 || outputCols <= 0) {
+        fprintf(stderr, "Invalid convolution dimensions\n");
+        return NULL;
+    }
+
+    Matrix* rowSums = createMatrix((outputRows - 1) * stride + filterRows, outputCols);
+    for (int i = 0; i < rowSums->rows; i++) {
+        for (int j = 0; j < outputCols; j++) {
+            int sum = 0;
+            for (int n = 0; n < filterCols; n++) {
+                sum += input->data[i][j*stride + n] * row[n];
+            }
+            rowSums->data[i][j] = sum;
+        }
+    }
+
+    Matrix* output = createMatrix(outputRows, outputCols);
+    for (int i = 0; i < outputRows; i++) {
+        for (int j = 0; j < outputCols; j++) {
+            int sum = 0;
+            for (int m = 0; m < filterRows; m++) {
+                sum += rowSums->data[i*stride + m][j] * column[m];
+            }
+            output->data[i][j] = sum;
+        }
+    }
+
+    freeMatrix(rowSums);
+    return output;
+}
+
+// Winograd minimal filtering F(m x m, 3 x 3): an output tile is
+// AT * (U .* (BT * d * B)) * A for the alpha x alpha input tile d, where
+// U = G * g * GT is the filter transformed once. G has fractions, so it is
+// stored times its denominator and U comes out scale times too large but
+// integral; dividing the tile by scale at the end is exact because the
+// true sums are integers.
+typedef struct {
+    int m;       // output tile size
+    int alpha;   // input tile size, m + 2
+    int scale;
+    const int* BT;   // alpha x alpha
+    const int* G;    // alpha x 3, scaled
+    const int* AT;   // m x alpha
+} WinogradTransform;
+
+const int winograd2BT[] = {
+    1,  0, -1,  0,
+    0,  1,  1,  0,
+    0, -1,  1,  0,
+    0,  1,  0, -1
+};
+const int winograd2G[] = {
+    2,  0,  0,
+    1,  1,  1,
+    1, -1,  1,
+    0,  0,  2
+};
+const int winograd2AT[] = {
+    1,  1,  1,  0,
+    0,  1, -1, -1
+};
+
+const int winograd4BT[] = {
+    4,  0, -5,  0,  1,  0,
+    0, -4, -4,  1,  1,  0,
+    0,  4, -4, -1,  1,  0,
+    0, -2, -1,  2,  1,  0,
+    0,  2, -1, -2,  1,  0,
+    0,  4,  0, -5,  0,  1
+};
+const int winograd4G[] = {
+    6,  0,  0,
+   -4, -4, -4,
+   -4,  4, -4,
+    1,  2,  4,
+    1, -2,  4,
+    0,  0, 24
+};
+const int winograd4AT[] = {
+    1,  1,  1,  1,  1,  0,
+    0,  1, -1,  2, -2,  0,
+    0,  1,  1,  4,  4,  0,
+    0,  1, -1,  8, -8,  1
+};
+
+const WinogradTransform winogradF2 = {2, 4, 4, winograd2BT, winograd2G, winograd2AT};
+const WinogradTransform winogradF4 = {4, 6, 576, winograd4BT, winograd4G, winograd4AT};
+
+#define WINOGRAD_MAX_ALPHA 6
+
+// F(4x4, 3x3) needs 2.25 multiplies per output against F(2x2, 3x3)'s 4, but
+// wastes more of its last tiles on small outputs
+const WinogradTransform* chooseWinograd(Matrix* input) {
+    if (input->rows - 2 >= 4 && input->cols - 2 >= 4) return &winogradF4;
+    return &winogradF2;
+}
+
+// U = G * filter * GT for a 3x3 filter, alpha x alpha
+void transformFilter(Matrix* filter, const WinogradTransform* t, long long* U) {
+    long long Gg[WINOGRAD_MAX_ALPHA][3];
+    for (int i = 0; i < t->alpha; i++) {
+        for (int j = 0; j < 3; j++) {
+            Gg[i][j] = 0;
+            for (int k = 0; k < 3; k++) {
+                Gg[i][j] += (long long)t->G[i * 3 + k] * filter->data[k][j];
+            }
+        }
+    }
+    for (int i = 0; i < t->alpha; i++) {
+        for (int j = 0; j < t->alpha; j++) {
+            U[i * t->alpha + j] = 0;
+            for (int k = 0; k < 3; k++) {
+                U[i * t->alpha + j] += Gg[i][k] * t->G[j * 3 + k];
+            }
+        }
+    }
+}
+
+// convolve() at stride 1 for a 3x3 filter transformed by transformFilter().
+// Tiles past the input edge read zeros and keep only their valid outputs.
+// Sums are formed in long long, so outputs match convolve() whenever its
+// int sums do not overflow.
+Matrix* convolveWinograd(Matrix* input, const WinogradTransform* t, const long long* U) {
+    int outputRows = input->rows - 2;
+    int outputCols = input->cols - 2;
+
+    if (outputRows <= 0 || outputCols <= 0) {
+        fprintf(stderr, "Invalid convolution dimensions\n");
+        return NULL;
+    }
+
+    Matrix* output = createMatrix(outputRows, outputCols);
+    int alpha = t->alpha;
+    long long d[WINOGRAD_MAX_ALPHA][WINOGRAD_MAX_ALPHA];
+    long long tmp[WINOGRAD_MAX_ALPHA][WINOGRAD_MAX_ALPHA];
+    long long V[WINOGRAD_MAX_ALPHA][WINOGRAD_MAX_ALPHA];
+
+    for (int ti = 0; ti < outputRows; ti += t->m) {
+        for (int tj = 0; tj < outputCols; tj += t->m) {
+            for (int i = 0; i < alpha; i++) {
+                for (int j = 0; j < alpha; j++) {
+                    int r = ti + i, c = tj + j;
+                    d[i][j] = r < input->rows && c < input->cols ? input->data[r][c] : 0;
+                }
+            }
+
+            // V = BT * d * B, then V .* U
+            for (int i = 0; i < alpha; i++) {
+                for (int j = 0; j < alpha; j++) {
+                    tmp[i][j] = 0;
+                    for (int k = 0; k < alpha; k++) tmp[i][j] += t->BT[i * alpha + k] * d[k][j];
+                }
+            }
+            for (int i = 0; i < alpha; i++) {
+                for (int j = 0; j < alpha; j++) {
+                    V[i][j] = 0;
+                    for (int k = 0; k < alpha; k++) V[i][j] += tmp[i][k] * t->BT[j * alpha + k];
+                    V[i][j] *= U[i * alpha + j];
+                }
+            }
+
+            // Y = AT * V * A
+            for (int i = 0; i < t->m; i++) {
+                for (int j = 0; j < alpha; j++) {
+                    tmp[i][j] = 0;
+                    for (int k = 0; k < alpha; k++) tmp[i][j] += t->AT[i * alpha + k] * V[k][j];
+                }
+            }
+            for (int i = 0; i < t->m && ti + i < outputRows; i++) {
+                for (int j = 0; j < t->m && tj + j < outputCols; j++) {
+                    long long sum = 0;
+                    for (int k = 0; k < alpha; k++) sum += tmp[i][k] * t->AT[j * alpha + k];
+                    output->data[ti + i][tj + j] = (int)(sum / t->scale);
+                }
+            }
+        }
+    }
+
+    return output;
+}
+
+// Reads the next nonblank CSV line into *values, growing it as needed.
+// Returns the number of values, or -1 at end of input.
+int readStreamRow(FILE* file, char** line, size_t* lineSize, int** values, int* capacity) {
+    while (getline(line, lineSize, file) >= 0) {
+        if (strspn(*line, " \t\r\n") == strlen(*line)) continue;
+
+        int count = 0;
+        char* token = strtok(*line, ",");
+        while (token) {
+            if (count == *capacity) {
+                *capacity = *capacity ? *capacity * 2 : 64;
+                *values = (int*)realloc(*values, *capacity * sizeof(int));
+                if (!*values) {
+                    fprintf(stderr, "Memory allocation failed for input row\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            (*values)[count++] = atoi(token);
+            token = strtok(NULL, ",");
+        }
+        return count;
+    }
+    return -1;
+}
+
+// Convolves every filter with an image streamed row by row from source,
+// keeping only the last size input rows in a ring (row r in
+// ring->data[r % size]), so memory is O(size * width) whatever the height.
+// The width comes from the first row; shorter rows are padded with 0 and
+// longer ones cut, as readMatrixFromCSV() does. Filter 1's rows are printed
+// as soon as they complete, the others spooled to temporary files and copied
+// out at the end, so the output matches the in-memory run.
+int convolveStream(FILE* source, Matrix* filtersMatrix, int numFilters, int stride) {
+    int size = filtersMatrix->cols;
+    FILE** spools = (FILE**)calloc(numFilters, sizeof(FILE*));
+    if (!spools) {
+        fprintf(stderr, "Memory allocation failed for output spools\n");
+        exit(EXIT_FAILURE);
+    }
+    spools[0] = stdout;
+    for (int f = 1; f < numFilters; f++) {
+        spools[f] = tmpfile();
+        if (!spools[f]) {
+            fprintf(stderr, "Failed to create an output spool\n");
+            for (int g = 1; g < f; g++) fclose(spools[g]);
+            free(spools);
+            return 0;
+        }
+    }
+    for (int f = 0; f < numFilters; f++) {
+        fprintf(spools[f], "\nConvolution Result for Filter %d:\n", f + 1);
+    }
+
+    char* line = NULL;
+    size_t lineSize = 0;
+    int* values = NULL;
+    int capacity = 0;
+    Matrix* ring = NULL;
+    int outputCols = 0;
+    int outputRows = 0;
+    int count;
+
+    for (int r = 0; (count = readStreamRow(source, &line, &lineSize, &values, &capacity)) >= 0; r++) {
+        if (!ring) {
+            ring = createMatrix(size, count);
+            // Checked first: the division truncates toward zero, so a row
+            // narrower than the filter would still give one output column
+            outputCols = count < size ? 0 : ((count - size) / stride) + 1;
+        }
+        int* row = ring->data[r % size];
+        for (int j = 0; j < ring->cols; j++) {
+            row[j] = j < count ? values[j] : 0;
+        }
+
+        // Output row i reads input rows i*stride to i*stride + size - 1
+        int top = r - size + 1;
+        if (top < 0 || top % stride != 0 || outputCols <= 0) continue;
+
+        for (int f = 0; f < numFilters; f++) {
+            for (int j = 0; j < outputCols; j++) {
+                int sum = 0;
+                for (int m = 0; m < size; m++) {
+                    int* inputRow = ring->data[(top + m) % size];
+                    int* filterRow = filtersMatrix->data[f * size + m];
+                    for (int n = 0; n < size; n++) {
+                        sum += inputRow[j*stride + n] * filterRow[n];
+                    }
+                }
+                fprintf(spools[f], "%d ", sum);
+            }
+            fprintf(spools[f], "\n");
+        }
+        outputRows++;
+    }
+
+    if (outputRows == 0) {
+        for (int f = 0; f < numFilters; f++) {
+            fprintf(stderr, "Invalid convolution dimensions\n");
+        }
+    }
+
+    char buffer[4096];
+    for (int f = 1; f < numFilters; f++) {
+        size_t n;
+        rewind(spools[f]);
+        while ((n = fread(buffer, 1, sizeof(buffer), spools[f])) > 0) {
+            fwrite(buffer, 1, n, stdout);
+        }
+        fclose(spools[f]);
+    }
+
+    freeMatrix(ring);
+    free(values);
+    free(line);
+    free(spools);
+    return 1;
+}
+
 void printMatrix(Matrix* matrix) {
     if (!matrix) {
         printf("NULL matrix\n");
@@ -131,10 +491,43 @@ void printMatrix(Matrix* matrix) {
     }
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     const char* inputFile = "input.csv";
     const char* filtersFile = "filters.csv";
 
+    // --stream [file|-] reads the input a row at a time, from stdin for -,
+    // instead of loading it whole
+    if (argc > 1 && strcmp(argv[1], "--stream") == 0) {
+        if (argc > 2) inputFile = argv[2];
+
+        Matrix* filtersMatrix = readMatrixFromCSV(filtersFile);
+        if (!filtersMatrix) {
+            fprintf(stderr, "Failed to read filters matrix\n");
+            return EXIT_FAILURE;
+        }
+
+        int stride;
+        printf("Enter stride value: ");
+        if (scanf("%d", &stride) != 1 || stride <= 0) {
+            fprintf(stderr, "Invalid stride value\n");
+            freeMatrix(filtersMatrix);
+            return EXIT_FAILURE;
+        }
+
+        FILE* source = strcmp(inputFile, "-") == 0 ? stdin : fopen(inputFile, "r");
+        if (!source) {
+            fprintf(stderr, "Error opening file: %s\n", inputFile);
+            freeMatrix(filtersMatrix);
+            return EXIT_FAILURE;
+        }
+
+        int ok = convolveStream(source, filtersMatrix, filtersMatrix->rows / filtersMatrix->cols, stride);
+
+        if (source != stdin) fclose(source);
+        freeMatrix(filtersMatrix);
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     Matrix* inputMatrix = readMatrixFromCSV(inputFile);
     if (!inputMatrix) {
         fprintf(stderr, "Failed to read input matrix\n");
@@ -158,6 +551,16 @@ int main() {
     }
 
     int numFilters = filtersMatrix->rows / filtersMatrix->cols;
+    int* column = (int*)malloc(filtersMatrix->cols * sizeof(int));
+    int* row = (int*)malloc(filtersMatrix->cols * sizeof(int));
+    if (!column || !row) {
+        fprintf(stderr, "Memory allocation failed for filter factors\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // 3x3 filters at stride 1 take the Winograd path
+    const WinogradTransform* winograd = filtersMatrix->cols == 3 && stride == 1 ? chooseWinograd(inputMatrix) : NULL;
+    long long transformed[WINOGRAD_MAX_ALPHA * WINOGRAD_MAX_ALPHA];
 
     for (int f = 0; f < numFilters; f++) {
         Matrix* currentFilter = createMatrix(filtersMatrix->cols, filtersMatrix->cols);
@@ -168,7 +571,15 @@ int main() {
         }
 
         printf("\nConvolution Result for Filter %d:\n", f + 1);
-        Matrix* result = convolve(inputMatrix, currentFilter, stride);
+        Matrix* result;
+        if (winograd) {
+            transformFilter(currentFilter, winograd, transformed);
+            result = convolveWinograd(inputMatrix, winograd, transformed);
+        } else if (separateFilter(currentFilter, column, row)) {
+            result = convolveSeparable(inputMatrix, currentFilter->rows, column, currentFilter->cols, row, stride);
+        } else {
+            result = convolve(inputMatrix, currentFilter, stride);
+        }
         
         if (result) {
             printMatrix(result);
@@ -178,6 +589,8 @@ int main() {
         freeMatrix(currentFilter);
     }
 
+    free(column);
+    free(row);
     freeMatrix(inputMatrix);
     freeMatrix(filtersMatrix);
 
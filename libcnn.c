@@ -0,0 +1,2452 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <errno.h>
+#include <limits.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "cnncore.h"
+#include "libcnn.h"
+
+// Allocation accounting. Counters are thread-local so recording costs a few
+// adds and no synchronization.
+static __thread AllocationStats allocationStats;
+static __thread int allocationLayer = -1;
+
+void recordAllocation(size_t bytes) {
+    AllocationStats* stats = &allocationStats;
+    stats->allocations++;
+    stats->bytes += bytes;
+    stats->liveBytes += bytes;
+    if (stats->liveBytes > stats->peakBytes) stats->peakBytes = stats->liveBytes;
+
+    int l = allocationLayer;
+    if (l >= 0) {
+        stats->layerAllocations[l]++;
+        stats->layerBytes[l] += bytes;
+        if (stats->liveBytes > stats->layerPeakBytes[l]) stats->layerPeakBytes[l] = stats->liveBytes;
+    }
+}
+
+void recordFree(size_t bytes) {
+    allocationStats.frees++;
+    allocationStats.liveBytes -= bytes;
+}
+
+// Charges later allocations to layer (-1 for none) and returns the previous one
+int setAllocationLayer(int layer) {
+    int previous = allocationLayer;
+    allocationLayer = layer >= 0 && layer < MAX_LAYERS ? layer : -1;
+    return previous;
+}
+
+void getAllocationStats(AllocationStats* stats) {
+    *stats = allocationStats;
+}
+
+// Restarts the high-water marks from the current live bytes, e.g. before one
+// inference to measure its peak
+void resetAllocationPeak(void) {
+    allocationStats.peakBytes = allocationStats.liveBytes;
+    for (int l = 0; l < MAX_LAYERS; l++) allocationStats.layerPeakBytes[l] = allocationStats.liveBytes;
+}
+
+size_t matrixBytes(int rows, int cols) {
+    return sizeof(Matrix) + (size_t)rows * sizeof(float*) + (size_t)rows * cols * sizeof(float);
+}
+
+Matrix* createMatrix(int rows, int cols) {
+    Matrix* matrix = (Matrix*)malloc(sizeof(Matrix));
+    if (!matrix) {
+        fprintf(stderr, "Memory allocation failed for matrix structure\n");
+        exit(EXIT_FAILURE);
+    }
+
+    matrix->rows = rows;
+    matrix->cols = cols;
+
+    matrix->data = (float**)malloc(rows * sizeof(float*));
+    if (!matrix->data) {
+        free(matrix);
+        fprintf(stderr, "Memory allocation failed for matrix rows\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < rows; i++) {
+        matrix->data[i] = (float*)calloc(cols, sizeof(float));
+        if (!matrix->data[i]) {
+            for (int j = 0; j < i; j++) {
+                free(matrix->data[j]);
+            }
+            free(matrix->data);
+            free(matrix);
+            fprintf(stderr, "Memory allocation failed for matrix columns\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    recordAllocation(matrixBytes(rows, cols));
+    return matrix;
+}
+
+void freeMatrix(Matrix* matrix) {
+    if (!matrix) return;
+
+    recordFree(matrixBytes(matrix->rows, matrix->cols));
+    for (int i = 0; i < matrix->rows; i++) {
+        free(matrix->data[i]);
+    }
+    free(matrix->data);
+    free(matrix);
+}
+
+Matrix* readMatrixFromCSV(const char* filename) {
+    FILE* file = fopen(filename, "r");
+    if (!file) {
+        fprintf(stderr, "Error opening file: %s\n", filename);
+        return NULL;
+    }
+
+    const int maxValues = 2000; 
+    float* tempData = (float*)malloc(maxValues * sizeof(float));
+    if (!tempData) {
+        fprintf(stderr, "Memory allocation failed for temporary storage\n");
+        fclose(file);
+        return NULL;
+    }
+
+    int totalValues = 0;
+    char line[8192]; 
+    char* position;
+
+    while (fgets(line, sizeof(line), file)) {
+        char* token = strtok_r(line, ", \n", &position);
+        while (token) {
+            if (totalValues < maxValues) {
+                tempData[totalValues] = atof(token);
+                totalValues++;
+            } else {
+                fprintf(stderr, "Exceeded maximum expected values\n");
+                break;
+            }
+            token = strtok_r(NULL, ", \n", &position);
+        }
+    }
+
+    fclose(file);
+
+    Matrix* matrix = createMatrix(1, totalValues); 
+    for (int i = 0; i < totalValues; i++) {
+        matrix->data[0][i] = tempData[i];
+    }
+
+    free(tempData);
+
+    return matrix;
+}
+
+Matrix* readFiltersFromCSV(const char* filename) {
+    FILE* file = fopen(filename, "r");
+    if (!file) {
+        fprintf(stderr, "Error opening file: %s\n", filename);
+        return NULL;
+    }
+
+    int rows = 0, cols = 0;
+    char line[4096];
+    char* position;
+    
+    while (fgets(line, sizeof(line), file)) {
+        rows++;
+        if (rows == 1) {
+            char* token = strtok_r(line, ",", &position);
+            while (token) {
+                cols++;
+                token = strtok_r(NULL, ",", &position);
+            }
+        }
+    }
+    Matrix* matrix = createMatrix(rows, cols);
+    rewind(file);
+    for (int i = 0; i < rows; i++) {
+        if (!fgets(line, sizeof(line), file)) break;
+        
+        char* token = strtok_r(line, ",", &position);
+        for (int j = 0; j < cols && token; j++) {
+            matrix->data[i][j] = atof(token);
+            token = strtok_r(NULL, ",", &position);
+        }
+    }
+
+    fclose(file);
+    return matrix;
+}
+
+Matrix* readBiasesFromCSV(const char* filename) {
+    FILE* file = fopen(filename, "r");
+    if (!file) {
+        fprintf(stderr, "Error opening file: %s\n", filename);
+        return NULL;
+    }
+
+    int rows = 0;
+    char line[4096];
+    
+    while (fgets(line, sizeof(line), file)) {
+        rows++;
+    }
+    rewind(file);
+
+    Matrix* matrix = createMatrix(rows, 1);  
+    for (int i = 0; i < rows; i++) {
+        if (!fgets(line, sizeof(line), file)) break;
+        matrix->data[i][0] = atof(line);  
+    }
+
+    fclose(file);
+    return matrix;
+}
+
+static const double powersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static const unsigned char csvDelimiters[256] = {
+    [','] = 1, [' '] = 1, ['\n'] = 1, ['\r'] = 1, ['\t'] = 1
+};
+
+int isCSVDelimiter(char c) {
+    return csvDelimiters[(unsigned char)c];
+}
+
+// Returns 1 if the 8 bytes at p are all ASCII digits
+int isEightDigits(const char* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return (((v & 0xF0F0F0F0F0F0F0F0ULL) | (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) == 0x3333333333333333ULL);
+}
+
+// Converts 8 ASCII digits to their value with three multiplies (SWAR)
+uint32_t parseEightDigits(const char* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    v -= 0x3030303030303030ULL;
+    v = (v * 10) + (v >> 8);
+    v = (((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+         (((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+    return (uint32_t)v;
+}
+
+// Locale-independent parser for the token starting at start, which ends at
+// the next CSV delimiter or at end; *next is set to the end of the token.
+// When the significant digits fit in 53 bits and the decimal exponent is
+// within +-22, one exact multiply or divide gives the correctly rounded double
+// (Clinger's fast path); anything else falls back to strtod. Either way the
+// result equals atof().
+double parseDecimal(const char* start, const char* end, const char** next) {
+    const char* p = start;
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    int sawDigit = 0;
+
+    // Leading zeros carry no significance
+    while (p < end && *p == '0') {
+        sawDigit = 1;
+        p++;
+    }
+    while (p < end && *p >= '0' && *p <= '9') {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits++;
+        sawDigit = 1;
+        p++;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        if (!mantissa) {
+            while (p < end && *p == '0') {
+                exponent--;
+                sawDigit = 1;
+                p++;
+            }
+        }
+        const char* fractionStart = p;
+        while (end - p >= 8 && digits <= 11 && isEightDigits(p)) {
+            mantissa = mantissa * 100000000ULL + parseEightDigits(p);
+            digits += 8;
+            p += 8;
+        }
+        while (p < end && *p >= '0' && *p <= '9') {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits++;
+            p++;
+        }
+        exponent -= (int)(p - fractionStart);
+        if (p > fractionStart) sawDigit = 1;
+    }
+    if (sawDigit && p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        int expNegative = 0;
+        if (q < end && (*q == '-' || *q == '+')) {
+            expNegative = *q == '-';
+            q++;
+        }
+        int expValue = 0;
+        int expDigits = 0;
+        while (q < end && *q >= '0' && *q <= '9' && expValue < 10000) {
+            expValue = expValue * 10 + (*q - '0');
+            expDigits++;
+            q++;
+        }
+        if (expDigits > 0) {
+            exponent += expNegative ? -expValue : expValue;
+            p = q;
+        }
+    }
+
+    if (sawDigit && (p == end || isCSVDelimiter(*p)) && digits <= 19 &&
+        mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+        *next = p;
+        double value = (double)mantissa;
+        value = exponent < 0 ? value / powersOfTen[-exponent] : value * powersOfTen[exponent];
+        return negative ? -value : value;
+    }
+
+    // Long mantissas, huge exponents, inf/nan and malformed tokens
+    while (p < end && !isCSVDelimiter(*p)) p++;
+    *next = p;
+
+    // strtod needs a terminated copy; tokens too long for the stack buffer
+    // are copied whole so that no digits are lost
+    char buffer[128];
+    size_t length = p - start;
+    char* token = length < sizeof(buffer) ? buffer : (char*)malloc(length + 1);
+    if (!token) {
+        fprintf(stderr, "Memory allocation failed for number\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(token, start, length);
+    token[length] = '\0';
+    double value = strtod(token, NULL);
+    if (token != buffer) free(token);
+    return value;
+}
+
+// Reads every comma/whitespace separated value of a file into one row. The
+// file is mmapped and parsed in place in a single pass, so there are no
+// line-length or value-count limits and tokens are never split.
+Matrix* readMatrixFromCSVMapped(const char* filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error opening file: %s\n", filename);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "Error reading file size: %s\n", filename);
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = (size_t)st.st_size;
+    if (size == 0) {
+        close(fd);
+        return createMatrix(1, 0);
+    }
+
+    const char* data = (const char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Error mapping file: %s\n", filename);
+        return NULL;
+    }
+    madvise((void*)data, size, MADV_SEQUENTIAL);
+
+    // Grown geometrically; large reallocs are remapped rather than copied
+    long capacity = size / 16 + 1024;
+    long totalValues = 0;
+    float* row = (float*)malloc(capacity * sizeof(float));
+    if (!row) {
+        fprintf(stderr, "Memory allocation failed for temporary storage\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const char* end = data + size;
+    const char* p = data;
+    while (p < end) {
+        while (p < end && isCSVDelimiter(*p)) p++;
+        if (p == end) break;
+        if (totalValues == capacity) {
+            capacity *= 2;
+            row = (float*)realloc(row, capacity * sizeof(float));
+            if (!row) {
+                fprintf(stderr, "Memory allocation failed for temporary storage\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        row[totalValues++] = parseDecimal(p, end, &p);
+    }
+
+    munmap((void*)data, size);
+
+    if (totalValues > 0x7fffffffL) {
+        fprintf(stderr, "Too many values in file: %s\n", filename);
+        free(row);
+        return NULL;
+    }
+
+    // Adopt the parsed buffer as the matrix row instead of copying it
+    Matrix* matrix = (Matrix*)malloc(sizeof(Matrix));
+    float** rows = (float**)malloc(sizeof(float*));
+    float* shrunk = (float*)realloc(row, (totalValues > 0 ? totalValues : 1) * sizeof(float));
+    if (!matrix || !rows || !shrunk) {
+        fprintf(stderr, "Memory allocation failed for matrix structure\n");
+        exit(EXIT_FAILURE);
+    }
+    rows[0] = shrunk;
+    matrix->rows = 1;
+    matrix->cols = (int)totalValues;
+    matrix->data = rows;
+    recordAllocation(matrixBytes(1, matrix->cols));
+    return matrix;
+}
+
+// Deterministic synthetic signals shaped like test.csv: a baseline between
+// -0.03 and -0.1 with slow wander and correlated noise, and a beat every ~300
+// samples peaking around 1.3. Used by the benchmark and regression tools.
+#define SIGNAL_BASELINE -0.04
+#define SIGNAL_BEAT_PERIOD 298
+#define SIGNAL_BEAT_JITTER 12
+#define SIGNAL_BEAT_HEIGHT 1.3
+
+typedef struct {
+    uint64_t state;
+} SignalRandom;
+
+double nextUniform(SignalRandom* random) {
+    // xorshift64*
+    random->state ^= random->state >> 12;
+    random->state ^= random->state << 25;
+    random->state ^= random->state >> 27;
+    return ((random->state * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+double nextGaussian(SignalRandom* random) {
+    double u = nextUniform(random);
+    double v = nextUniform(random);
+    return sqrt(-2.0 * log(u + 1e-300)) * cos(2.0 * M_PI * v);
+}
+
+double pulse(double t, double centre, double width) {
+    double d = (t - centre) / width;
+    return exp(-0.5 * d * d);
+}
+
+// Fills one signal of length samples; the content depends only on seed and index
+void generateSignal(float* signal, int length, uint64_t seed, long index) {
+    SignalRandom random = {seed * 0x9e3779b97f4a7c15ULL + (uint64_t)index * 0xbf58476d1ce4e5b9ULL + 1};
+    for (int i = 0; i < 4; i++) nextUniform(&random);
+
+    double wanderPhase = nextUniform(&random) * 2.0 * M_PI;
+    double wanderPeriod = 800.0 + nextUniform(&random) * 800.0;
+    double noise = 0.0;
+    for (int i = 0; i < length; i++) {
+        noise = 0.95 * noise + 0.012 * nextGaussian(&random);
+        signal[i] = (float)(SIGNAL_BASELINE + 0.03 * sin(2.0 * M_PI * i / wanderPeriod + wanderPhase) + noise);
+    }
+
+    // Q dip, R peak, S dip and a broad T wave per beat
+    double beat = nextUniform(&random) * SIGNAL_BEAT_PERIOD;
+    while (beat < length + 60) {
+        double height = SIGNAL_BEAT_HEIGHT + 0.1 * nextGaussian(&random);
+        int from = beat > 80 ? (int)beat - 80 : 0;
+        int to = beat + 80 < length ? (int)beat + 80 : length;
+        for (int i = from; i < to; i++) {
+            signal[i] += (float)(height * pulse(i, beat, 2.2) - 0.12 * pulse(i, beat - 5, 2.0)
+                                 - 0.10 * pulse(i, beat + 5, 2.0) + 0.08 * pulse(i, beat + 60, 15.0));
+        }
+        beat += SIGNAL_BEAT_PERIOD + (nextUniform(&random) * 2.0 - 1.0) * SIGNAL_BEAT_JITTER;
+    }
+}
+
+float relu(float x) {
+    return x > 0 ? x : 0;
+}
+
+float leakyRelu(float x) {
+    float alpha = 0.1;
+    return x > 0 ? x : alpha * x;
+}
+
+float selu(float x, float alpha, float scale) {
+    return x > 0 ? scale * x : scale * alpha * (exp(x) - 1);
+}
+
+float elu(float x, float alpha) {
+    return x > 0 ? x : alpha * (exp(x) - 1);
+}
+
+Matrix* convolve(Matrix* input, Matrix* filter, Matrix* bias, int stride) {
+    int outputRows = ((input->rows - filter->rows) / stride) + 1;
+    int outputCols = ((input->cols - filter->cols) / stride) + 1;
+
+    if (outputRows <= 0 || outputCols <= 0) {
+        fprintf(stderr, "Invalid convolution dimensions\n");
+        return NULL;
+    }
+
+    uint64_t span = traceBegin();
+    Matrix* output = createMatrix(outputRows, outputCols);
+
+    for (int i = 0; i < outputRows; i++) {
+        for (int j = 0; j < outputCols; j++) {
+            float sum = 0;
+            for (int m = 0; m < filter->rows; m++) {
+                for (int n = 0; n < filter->cols; n++) {
+                    sum += input->data[i * stride + m][j * stride + n] * filter->data[m][n];
+                }
+            }
+            sum += bias->data[0][0];
+            sum = leakyRelu(sum);  
+            output->data[i][j] = sum;
+        }
+    }
+
+    traceEnd("conv", -1, span);
+    return output;
+}
+
+Matrix* maxPool(Matrix* input, int poolRows, int poolCols, int stride) {
+    int outputRows = ((input->rows - poolRows) / stride) + 1;
+    int outputCols = ((input->cols - poolCols) / stride) + 1;
+
+    if (outputRows <= 0 || outputCols <= 0) {
+        fprintf(stderr, "Invalid pooling dimensions\n");
+        return NULL;
+    }
+
+    uint64_t span = traceBegin();
+    Matrix* output = createMatrix(outputRows, outputCols);
+
+    for (int i = 0; i < outputRows; i++) {
+        for (int j = 0; j < outputCols; j++) {
+            float maxVal = -INFINITY;
+            for (int m = 0; m < poolRows; m++) {
+                for (int n = 0; n < poolCols; n++) {
+                    int rowIndex = i * stride + m;
+                    int colIndex = j * stride + n;
+                    if (rowIndex < input->rows && colIndex < input->cols) {
+                        if (input->data[rowIndex][colIndex] > maxVal) {
+                            maxVal = input->data[rowIndex][colIndex];
+                        }
+                    }
+                }
+            }
+            output->data[i][j] = maxVal;
+        }
+    }
+
+    traceEnd("pool", -1, span);
+    return output;
+}
+
+float applyActivation(const Layer* layer, float x) {
+    switch (layer->activation) {
+    case ACTIVATION_RELU:
+        return relu(x);
+    case ACTIVATION_LEAKY_RELU:
+        return x > 0 ? x : layer->alpha * x;
+    case ACTIVATION_ELU:
+        return elu(x, layer->alpha);
+    case ACTIVATION_SELU:
+        return selu(x, layer->alpha, layer->scale);
+    default:
+        return x;
+    }
+}
+
+// Whether the layer's activation never decreases, so that
+// max(act(x + b)) == act(max(x) + b) holds exactly: adding a constant in
+// float rounding is monotonic too. ELU and SELU need alpha >= 0.
+int isMonotonicActivation(const Layer* layer) {
+    switch (layer->activation) {
+    case ACTIVATION_NONE:
+    case ACTIVATION_RELU:
+        return 1;
+    case ACTIVATION_LEAKY_RELU:
+    case ACTIVATION_ELU:
+        return layer->alpha >= 0;
+    case ACTIVATION_SELU:
+        return layer->alpha >= 0 && layer->scale > 0;
+    default:
+        return 0;
+    }
+}
+
+// Graph pass run by the loaders: layers whose activation is monotonic add
+// their bias and activate after pooling, touching poolLength values per
+// filter instead of convLength. The reference pipeline ignores the flag.
+// Returns the number of layers reordered.
+int reorderPoolActivation(Model* model) {
+    int reordered = 0;
+    for (int l = 0; l < model->numLayers; l++) {
+        Layer* layer = &model->layers[l];
+        layer->activateAfterPool = isMonotonicActivation(layer);
+        reordered += layer->activateAfterPool;
+    }
+    return reordered;
+}
+
+// The layer-by-layer pipeline of 3rdlayer's default mode: every chain copies
+// its filter and bias into fresh matrices and goes through convolve() and
+// maxPool(), keeping each result alive while the layers below it run.
+// Allocations are charged to the layer that makes them. Returns the position
+// after the last value written, or NULL on invalid dimensions.
+float* referenceLayer(const Model* model, int l, Matrix* input, float* output) {
+    const Layer* layer = &model->layers[l];
+    int previous = setAllocationLayer(l);
+
+    for (int f = 0; f < layer->filters->rows && output; f++) {
+        Matrix* filter = createMatrix(1, layer->filters->cols);
+        memcpy(filter->data[0], layer->filters->data[f], layer->filters->cols * sizeof(float));
+        Matrix* bias = createMatrix(1, 1);
+        bias->data[0][0] = layer->biases->data[f][0];
+
+        Matrix* conv = convolve(input, filter, bias, layer->stride);
+        Matrix* pooled = conv ? maxPool(conv, layer->poolRows, layer->poolCols, layer->poolStride) : NULL;
+        if (!pooled || pooled->rows != 1) {
+            output = NULL;
+        } else if (l == model->numLayers - 1) {
+            memcpy(output, pooled->data[0], pooled->cols * sizeof(float));
+            output += pooled->cols;
+        } else {
+            output = referenceLayer(model, l + 1, pooled, output);
+            setAllocationLayer(l);
+        }
+
+        freeMatrix(pooled);
+        freeMatrix(conv);
+        freeMatrix(filter);
+        freeMatrix(bias);
+    }
+
+    setAllocationLayer(previous);
+    return output;
+}
+
+// Runs one signal through referenceLayer(), writing the same layout as
+// inferWorkspace(). convolve() always applies leakyRelu, so only models made
+// entirely of 0.1 leaky relu layers qualify; returns 0 for any other model or
+// on invalid dimensions.
+int inferReference(const Model* model, const float* input, int inputLength, float* output) {
+    for (int l = 0; l < model->numLayers; l++) {
+        if (model->layers[l].activation != ACTIVATION_LEAKY_RELU || model->layers[l].alpha != 0.1f) return 0;
+    }
+
+    uint64_t span = traceBegin();
+    Matrix* view = createMatrixView(1, inputLength, (float*)input);
+    float* end = referenceLayer(model, 0, view, output);
+    freeMatrixView(view);
+    traceEnd("infer reference", -1, span);
+    return end != NULL;
+}
+
+// Wraps rows of an existing buffer without copying; free with freeMatrixView()
+Matrix* createMatrixView(int rows, int cols, float* data) {
+    Matrix* matrix = (Matrix*)malloc(sizeof(Matrix));
+    float** rowPointers = (float**)malloc((rows > 0 ? rows : 1) * sizeof(float*));
+    if (!matrix || !rowPointers) {
+        fprintf(stderr, "Memory allocation failed for matrix view\n");
+        exit(EXIT_FAILURE);
+    }
+
+    matrix->rows = rows;
+    matrix->cols = cols;
+    matrix->data = rowPointers;
+    for (int i = 0; i < rows; i++) {
+        matrix->data[i] = data + (size_t)i * cols;
+    }
+    return matrix;
+}
+
+void freeMatrixView(Matrix* matrix) {
+    if (!matrix) return;
+    free(matrix->data);
+    free(matrix);
+}
+
+void freeModel(Model* model) {
+    for (int l = 0; l < model->numLayers; l++) {
+        if (model->mapping) {
+            freeMatrixView(model->layers[l].filters);
+            freeMatrixView(model->layers[l].biases);
+        } else {
+            freeMatrix(model->layers[l].filters);
+            freeMatrix(model->layers[l].biases);
+        }
+    }
+    if (model->mapping) {
+        munmap(model->mapping, model->mappingSize);
+    }
+    if (model->packMapping) {
+        munmap(model->packMapping, model->packMappingSize);
+    } else if (model->packed) {
+        for (int l = 0; l < model->numLayers; l++) {
+            free(model->packedLayers[l].weights);
+            free(model->packedLayers[l].biases);
+        }
+    }
+    model->numLayers = 0;
+    model->mapping = NULL;
+    model->packed = 0;
+    model->packMapping = NULL;
+}
+
+// Builds a leaky relu model from one filter and one bias CSV per layer, all
+// layers sharing the same stride and pooling. Returns 0 on failure.
+int loadModelFromCSV(Model* model, int numLayers, const char** filterFiles, const char** biasFiles,
+                     int stride, int poolRows, int poolCols, int poolStride) {
+    memset(model, 0, sizeof(Model));
+
+    if (numLayers > MAX_LAYERS) {
+        fprintf(stderr, "Too many layers: %d\n", numLayers);
+        return 0;
+    }
+
+    for (int l = 0; l < numLayers; l++) {
+        Layer* layer = &model->layers[l];
+        layer->filters = readFiltersFromCSV(filterFiles[l]);
+        layer->biases = readBiasesFromCSV(biasFiles[l]);
+        model->numLayers = l + 1;
+
+        if (!layer->filters || !layer->biases) {
+            freeModel(model);
+            return 0;
+        }
+        if (layer->filters->rows != layer->biases->rows) {
+            fprintf(stderr, "Layer %d has %d filters but %d biases\n", l + 1, layer->filters->rows, layer->biases->rows);
+            freeModel(model);
+            return 0;
+        }
+
+        layer->stride = stride;
+        layer->poolRows = poolRows;
+        layer->poolCols = poolCols;
+        layer->poolStride = poolStride;
+        layer->activation = ACTIVATION_LEAKY_RELU;
+        layer->alpha = 0.1f;
+        layer->scale = 1.0f;
+    }
+
+    reorderPoolActivation(model);
+    return 1;
+}
+
+// Binary model format, version 1 (native little-endian):
+//
+//   ModelFileHeader
+//   ModelFileLayer[numLayers]
+//   per layer, each at a MODEL_FILE_ALIGNMENT-aligned offset:
+//     float weights[numFilters][filterCols]
+//     float biases[numFilters]
+//
+// The file is mmapped and the float blobs are used in place.
+#define MODEL_FILE_MAGIC "CNNMODEL"
+#define MODEL_FILE_VERSION 1
+#define MODEL_FILE_ALIGNMENT 64
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t numLayers;
+    uint32_t headerSize;     // sizeof(ModelFileHeader) + numLayers * sizeof(ModelFileLayer)
+    uint32_t alignment;
+    uint64_t fileSize;
+} ModelFileHeader;
+
+typedef struct {
+    uint32_t numFilters;
+    uint32_t filterRows;
+    uint32_t filterCols;
+    uint32_t stride;
+    uint32_t poolRows;
+    uint32_t poolCols;
+    uint32_t poolStride;
+    uint32_t activation;
+    float alpha;
+    float scale;
+    uint64_t weightsOffset;
+    uint64_t biasesOffset;
+} ModelFileLayer;
+
+uint64_t alignOffset(uint64_t offset) {
+    return (offset + MODEL_FILE_ALIGNMENT - 1) & ~(uint64_t)(MODEL_FILE_ALIGNMENT - 1);
+}
+
+int writePadding(FILE* file, uint64_t from, uint64_t to) {
+    static const char zeros[MODEL_FILE_ALIGNMENT] = {0};
+    return to == from || fwrite(zeros, 1, to - from, file) == to - from;
+}
+
+int saveModelBinary(const Model* model, const char* filename) {
+    ModelFileHeader header;
+    ModelFileLayer layers[MAX_LAYERS];
+    memset(&header, 0, sizeof(header));
+    memset(layers, 0, sizeof(layers));
+
+    memcpy(header.magic, MODEL_FILE_MAGIC, sizeof(header.magic));
+    header.version = MODEL_FILE_VERSION;
+    header.numLayers = model->numLayers;
+    header.headerSize = sizeof(ModelFileHeader) + model->numLayers * sizeof(ModelFileLayer);
+    header.alignment = MODEL_FILE_ALIGNMENT;
+
+    uint64_t offset = header.headerSize;
+    for (int l = 0; l < model->numLayers; l++) {
+        const Layer* layer = &model->layers[l];
+        ModelFileLayer* entry = &layers[l];
+        entry->numFilters = layer->filters->rows;
+        entry->filterRows = 1;
+        entry->filterCols = layer->filters->cols;
+        entry->stride = layer->stride;
+        entry->poolRows = layer->poolRows;
+        entry->poolCols = layer->poolCols;
+        entry->poolStride = layer->poolStride;
+        entry->activation = layer->activation;
+        entry->alpha = layer->alpha;
+        entry->scale = layer->scale;
+
+        offset = alignOffset(offset);
+        entry->weightsOffset = offset;
+        offset += (uint64_t)entry->numFilters * entry->filterCols * sizeof(float);
+        offset = alignOffset(offset);
+        entry->biasesOffset = offset;
+        offset += (uint64_t)entry->numFilters * sizeof(float);
+    }
+    header.fileSize = offset;
+
+    FILE* file = fopen(filename, "wb");
+    if (!file) {
+        fprintf(stderr, "Error opening file: %s\n", filename);
+        return 0;
+    }
+
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(layers, sizeof(ModelFileLayer), model->numLayers, file) == (size_t)model->numLayers;
+    uint64_t position = header.headerSize;
+
+    for (int l = 0; ok && l < model->numLayers; l++) {
+        const Layer* layer = &model->layers[l];
+        ok = writePadding(file, position, layers[l].weightsOffset);
+        position = layers[l].weightsOffset;
+        for (int f = 0; ok && f < layer->filters->rows; f++) {
+            ok = fwrite(layer->filters->data[f], sizeof(float), layer->filters->cols, file) == (size_t)layer->filters->cols;
+            position += layer->filters->cols * sizeof(float);
+        }
+
+        ok = ok && writePadding(file, position, layers[l].biasesOffset);
+        position = layers[l].biasesOffset;
+        for (int f = 0; ok && f < layer->biases->rows; f++) {
+            ok = fwrite(&layer->biases->data[f][0], sizeof(float), 1, file) == 1;
+            position += sizeof(float);
+        }
+    }
+
+    if (fclose(file) != 0) ok = 0;
+    if (!ok) {
+        fprintf(stderr, "Error writing model file: %s\n", filename);
+    }
+    return ok;
+}
+
+// Maps a binary model and points every layer's filters and biases into the
+// mapping, so loading does no parsing and no copying. Returns 0 on failure.
+int loadModelBinary(Model* model, const char* filename) {
+    memset(model, 0, sizeof(Model));
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error opening file: %s\n", filename);
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ModelFileHeader)) {
+        fprintf(stderr, "Invalid model file: %s\n", filename);
+        close(fd);
+        return 0;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "Error mapping file: %s\n", filename);
+        return 0;
+    }
+
+    const ModelFileHeader* header = (const ModelFileHeader*)mapping;
+    const ModelFileLayer* layers = (const ModelFileLayer*)(header + 1);
+    const char* error = NULL;
+
+    if (memcmp(header->magic, MODEL_FILE_MAGIC, sizeof(header->magic)) != 0) {
+        error = "bad magic";
+    } else if (header->version != MODEL_FILE_VERSION) {
+        error = "unsupported version";
+    } else if (header->numLayers == 0 || header->numLayers > MAX_LAYERS ||
+               header->headerSize != sizeof(ModelFileHeader) + header->numLayers * sizeof(ModelFileLayer) ||
+               header->fileSize != size || header->headerSize > size) {
+        error = "inconsistent header";
+    }
+
+    for (uint32_t l = 0; !error && l < header->numLayers; l++) {
+        const ModelFileLayer* entry = &layers[l];
+        uint64_t weightsBytes = (uint64_t)entry->numFilters * entry->filterRows * entry->filterCols * sizeof(float);
+        uint64_t biasesBytes = (uint64_t)entry->numFilters * sizeof(float);
+
+        if (entry->numFilters == 0 || entry->filterRows != 1 || entry->filterCols == 0 ||
+            entry->stride == 0 || entry->poolStride == 0 || entry->poolCols == 0 ||
+            entry->activation > ACTIVATION_SELU) {
+            error = "invalid layer parameters";
+        } else if (entry->weightsOffset % sizeof(float) || entry->biasesOffset % sizeof(float) ||
+                   entry->weightsOffset > size || weightsBytes > size - entry->weightsOffset ||
+                   entry->biasesOffset > size || biasesBytes > size - entry->biasesOffset) {
+            error = "layer data out of bounds";
+        }
+    }
+
+    if (error) {
+        fprintf(stderr, "Invalid model file %s: %s\n", filename, error);
+        munmap(mapping, size);
+        return 0;
+    }
+
+    char* base = (char*)mapping;
+    for (uint32_t l = 0; l < header->numLayers; l++) {
+        const ModelFileLayer* entry = &layers[l];
+        Layer* layer = &model->layers[l];
+
+        // Views only read through these pointers; the mapping stays read-only
+        layer->filters = createMatrixView(entry->numFilters, entry->filterCols, (float*)(base + entry->weightsOffset));
+        layer->biases = createMatrixView(entry->numFilters, 1, (float*)(base + entry->biasesOffset));
+        layer->stride = entry->stride;
+        layer->poolRows = entry->poolRows;
+        layer->poolCols = entry->poolCols;
+        layer->poolStride = entry->poolStride;
+        layer->activation = (ActivationType)entry->activation;
+        layer->alpha = entry->alpha;
+        layer->scale = entry->scale;
+    }
+
+    model->numLayers = header->numLayers;
+    model->mapping = mapping;
+    model->mappingSize = size;
+    reorderPoolActivation(model);
+    return 1;
+}
+
+int paddedFilterLength(int filterLength) {
+    return (filterLength + PACK_WIDTH - 1) / PACK_WIDTH * PACK_WIDTH;
+}
+
+// Reorders one layer into the PackedLayer layout. weights and biases must
+// hold numBlocks * paddedLength * PACK_WIDTH and numBlocks * PACK_WIDTH floats.
+void packLayerInto(const Layer* layer, PackedLayer* packed, float* weights, float* biases) {
+    int numFilters = layer->filters->rows;
+    packed->numBlocks = (numFilters + PACK_WIDTH - 1) / PACK_WIDTH;
+    packed->filterLength = layer->filters->cols;
+    packed->paddedLength = paddedFilterLength(layer->filters->cols);
+    packed->weights = weights;
+    packed->biases = biases;
+
+    memset(weights, 0, (size_t)packed->numBlocks * packed->paddedLength * PACK_WIDTH * sizeof(float));
+    memset(biases, 0, (size_t)packed->numBlocks * PACK_WIDTH * sizeof(float));
+    for (int f = 0; f < numFilters; f++) {
+        float* block = weights + (size_t)(f / PACK_WIDTH) * packed->paddedLength * PACK_WIDTH;
+        for (int n = 0; n < packed->filterLength; n++) {
+            block[n * PACK_WIDTH + f % PACK_WIDTH] = layer->filters->data[f][n];
+        }
+        biases[f] = layer->biases->data[f][0];
+    }
+}
+
+void* allocatePacked(size_t bytes) {
+    void* buffer = NULL;
+    if (posix_memalign(&buffer, PACK_ALIGNMENT, bytes) != 0) {
+        fprintf(stderr, "Memory allocation failed for packed weights\n");
+        exit(EXIT_FAILURE);
+    }
+    return buffer;
+}
+
+// Packs every layer of a loaded model in memory
+void packModel(Model* model) {
+    for (int l = 0; l < model->numLayers; l++) {
+        const Layer* layer = &model->layers[l];
+        int numBlocks = (layer->filters->rows + PACK_WIDTH - 1) / PACK_WIDTH;
+        size_t weightsBytes = (size_t)numBlocks * paddedFilterLength(layer->filters->cols) * PACK_WIDTH * sizeof(float);
+        float* weights = (float*)allocatePacked(weightsBytes);
+        float* biases = (float*)allocatePacked((size_t)numBlocks * PACK_WIDTH * sizeof(float));
+        packLayerInto(layer, &model->packedLayers[l], weights, biases);
+    }
+    model->packed = 1;
+}
+
+// Pack cache: the packed weights of a binary model, stored next to it as
+// <model>.pack and tied to the model file by its size and modification time.
+//
+//   PackFileHeader
+//   PackFileLayer[numLayers]
+//   per layer, each at a PACK_ALIGNMENT-aligned offset:
+//     float weights[numBlocks][paddedLength][PACK_WIDTH]
+//     float biases[numBlocks][PACK_WIDTH]
+#define PACK_FILE_MAGIC "CNNPACK1"
+#define PACK_FILE_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t numLayers;
+    uint32_t packWidth;
+    uint32_t alignment;
+    uint64_t sourceSize;
+    int64_t sourceModified;  // nanoseconds since the epoch
+    uint64_t fileSize;
+} PackFileHeader;
+
+typedef struct {
+    uint32_t numFilters;
+    uint32_t filterLength;
+    uint32_t paddedLength;
+    uint32_t numBlocks;
+    uint64_t weightsOffset;
+    uint64_t biasesOffset;
+} PackFileLayer;
+
+uint64_t alignPackOffset(uint64_t offset) {
+    return (offset + PACK_ALIGNMENT - 1) & ~(uint64_t)(PACK_ALIGNMENT - 1);
+}
+
+int64_t modifiedNanoseconds(const struct stat* st) {
+    return (int64_t)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+}
+
+// Maps a pack cache and points the model's packed layers into it. Returns 0
+// when the cache is missing, stale or does not match the model; the caller
+// then packs in memory.
+int loadPackCache(Model* model, const char* filename, const struct stat* source) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(PackFileHeader)) {
+        close(fd);
+        return 0;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return 0;
+
+    const PackFileHeader* header = (const PackFileHeader*)mapping;
+    const PackFileLayer* layers = (const PackFileLayer*)(header + 1);
+    int valid = memcmp(header->magic, PACK_FILE_MAGIC, sizeof(header->magic)) == 0 &&
+                header->version == PACK_FILE_VERSION &&
+                header->packWidth == PACK_WIDTH &&
+                header->numLayers == (uint32_t)model->numLayers &&
+                header->fileSize == size &&
+                header->sourceSize == (uint64_t)source->st_size &&
+                header->sourceModified == modifiedNanoseconds(source) &&
+                sizeof(PackFileHeader) + header->numLayers * sizeof(PackFileLayer) <= size;
+
+    for (int l = 0; valid && l < model->numLayers; l++) {
+        const Layer* layer = &model->layers[l];
+        const PackFileLayer* entry = &layers[l];
+        uint64_t weightsBytes = (uint64_t)entry->numBlocks * entry->paddedLength * PACK_WIDTH * sizeof(float);
+        uint64_t biasesBytes = (uint64_t)entry->numBlocks * PACK_WIDTH * sizeof(float);
+
+        valid = entry->numFilters == (uint32_t)layer->filters->rows &&
+                entry->filterLength == (uint32_t)layer->filters->cols &&
+                entry->paddedLength == (uint32_t)paddedFilterLength(layer->filters->cols) &&
+                entry->numBlocks == (entry->numFilters + PACK_WIDTH - 1) / PACK_WIDTH &&
+                entry->weightsOffset % PACK_ALIGNMENT == 0 && entry->biasesOffset % PACK_ALIGNMENT == 0 &&
+                entry->weightsOffset <= size && weightsBytes <= size - entry->weightsOffset &&
+                entry->biasesOffset <= size && biasesBytes <= size - entry->biasesOffset;
+    }
+
+    if (!valid) {
+        munmap(mapping, size);
+        return 0;
+    }
+
+    char* base = (char*)mapping;
+    for (int l = 0; l < model->numLayers; l++) {
+        PackedLayer* packed = &model->packedLayers[l];
+        packed->numBlocks = layers[l].numBlocks;
+        packed->filterLength = layers[l].filterLength;
+        packed->paddedLength = layers[l].paddedLength;
+        packed->weights = (float*)(base + layers[l].weightsOffset);
+        packed->biases = (float*)(base + layers[l].biasesOffset);
+    }
+
+    model->packed = 1;
+    model->packMapping = mapping;
+    model->packMappingSize = size;
+    return 1;
+}
+
+int savePackCache(const Model* model, const char* filename, const struct stat* source) {
+    PackFileHeader header;
+    PackFileLayer layers[MAX_LAYERS];
+    memset(&header, 0, sizeof(header));
+    memset(layers, 0, sizeof(layers));
+
+    memcpy(header.magic, PACK_FILE_MAGIC, sizeof(header.magic));
+    header.version = PACK_FILE_VERSION;
+    header.numLayers = model->numLayers;
+    header.packWidth = PACK_WIDTH;
+    header.alignment = PACK_ALIGNMENT;
+    header.sourceSize = (uint64_t)source->st_size;
+    header.sourceModified = modifiedNanoseconds(source);
+
+    uint64_t offset = sizeof(PackFileHeader) + model->numLayers * sizeof(PackFileLayer);
+    for (int l = 0; l < model->numLayers; l++) {
+        const PackedLayer* packed = &model->packedLayers[l];
+        PackFileLayer* entry = &layers[l];
+        entry->numFilters = model->layers[l].filters->rows;
+        entry->filterLength = packed->filterLength;
+        entry->paddedLength = packed->paddedLength;
+        entry->numBlocks = packed->numBlocks;
+
+        offset = alignPackOffset(offset);
+        entry->weightsOffset = offset;
+        offset += (uint64_t)packed->numBlocks * packed->paddedLength * PACK_WIDTH * sizeof(float);
+        offset = alignPackOffset(offset);
+        entry->biasesOffset = offset;
+        offset += (uint64_t)packed->numBlocks * PACK_WIDTH * sizeof(float);
+    }
+    header.fileSize = offset;
+
+    // Written under a temporary name so a concurrent reader never maps a
+    // partial cache
+    char temporary[4096];
+    snprintf(temporary, sizeof(temporary), "%s.%ld.tmp", filename, (long)getpid());
+    FILE* file = fopen(temporary, "wb");
+    if (!file) return 0;
+
+    static const char zeros[PACK_ALIGNMENT] = {0};
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(layers, sizeof(PackFileLayer), model->numLayers, file) == (size_t)model->numLayers;
+    uint64_t position = sizeof(PackFileHeader) + model->numLayers * sizeof(PackFileLayer);
+
+    for (int l = 0; ok && l < model->numLayers; l++) {
+        const PackedLayer* packed = &model->packedLayers[l];
+        size_t weightsCount = (size_t)packed->numBlocks * packed->paddedLength * PACK_WIDTH;
+        size_t biasesCount = (size_t)packed->numBlocks * PACK_WIDTH;
+
+        ok = fwrite(zeros, 1, layers[l].weightsOffset - position, file) == layers[l].weightsOffset - position &&
+             fwrite(packed->weights, sizeof(float), weightsCount, file) == weightsCount;
+        position = layers[l].weightsOffset + weightsCount * sizeof(float);
+        ok = ok && fwrite(zeros, 1, layers[l].biasesOffset - position, file) == layers[l].biasesOffset - position &&
+             fwrite(packed->biases, sizeof(float), biasesCount, file) == biasesCount;
+        position = layers[l].biasesOffset + biasesCount * sizeof(float);
+    }
+
+    if (fclose(file) != 0) ok = 0;
+    if (!ok || rename(temporary, filename) != 0) {
+        remove(temporary);
+        return 0;
+    }
+    return 1;
+}
+
+// Prepacks a loaded model. With cacheModelFile set, the packed form is
+// reused from (or written to) <cacheModelFile>.pack.
+void prepackModel(Model* model, const char* cacheModelFile) {
+    struct stat source;
+    char cacheFile[4096];
+
+    if (!cacheModelFile || stat(cacheModelFile, &source) != 0) {
+        packModel(model);
+        return;
+    }
+
+    snprintf(cacheFile, sizeof(cacheFile), "%s.pack", cacheModelFile);
+    if (loadPackCache(model, cacheFile, &source)) return;
+
+    packModel(model);
+    if (!savePackCache(model, cacheFile, &source)) {
+        fprintf(stderr, "Warning: could not write pack cache %s\n", cacheFile);
+    }
+}
+
+// Formats the header of npy with signals leading entries (ignored unless
+// batched) into header, padded with spaces to size bytes. Returns the size the
+// header needs; nothing is written when that exceeds size.
+size_t formatNpyHeader(const NpyFile* npy, long signals, char* header, size_t size) {
+    // Up to MAX_LAYERS + 2 dimensions and the signal count, each at most 20
+    // digits and a separator
+    char shape[(MAX_LAYERS + 3) * 24];
+    int length = 0;
+
+    if (npy->batched) {
+        length += snprintf(shape + length, sizeof(shape) - length, "%ld, ", signals);
+    }
+    for (int d = 0; d < npy->ndim; d++) {
+        length += snprintf(shape + length, sizeof(shape) - length, "%ld, ", npy->shape[d]);
+    }
+    // One-element tuples keep their trailing comma, longer ones drop it
+    if (npy->ndim + npy->batched > 1) shape[length - 2] = '\0';
+
+    char dict[sizeof(shape) + 64];
+    int dictLength = snprintf(dict, sizeof(dict), "{'descr': '<f4', 'fortran_order': False, 'shape': (%s), }", shape);
+    // Magic, version, length, the dict and a closing newline
+    size_t needed = (10 + dictLength + 1 + 63) / 64 * 64;
+    if (!header || needed > size) return needed;
+
+    memcpy(header, "\x93NUMPY\x01\x00", 8);
+    header[8] = (char)((size - 10) & 0xff);
+    header[9] = (char)((size - 10) >> 8);
+    memcpy(header + 10, dict, dictLength);
+    memset(header + 10 + dictLength, ' ', size - 11 - dictLength);
+    header[size - 1] = '\n';
+    return needed;
+}
+
+void writeNpyHeader(NpyFile* npy) {
+    formatNpyHeader(npy, npy->signals, npy->mapping, npy->headerSize);
+}
+
+// Grows the file (and mapping) so at least signals signals fit
+int reserveNpySignals(NpyFile* npy, long signals) {
+    if (signals <= npy->capacity) return 1;
+
+    long capacity = npy->capacity > 0 ? npy->capacity : 1;
+    while (capacity < signals) capacity *= 2;
+
+    size_t bytes = npy->headerSize + capacity * npy->signalFloats * sizeof(float);
+    if (ftruncate(npy->fd, bytes) != 0) {
+        fprintf(stderr, "Error growing activation dump\n");
+        return 0;
+    }
+    char* mapping = npy->mapping ? (char*)mremap(npy->mapping, npy->mappedBytes, bytes, MREMAP_MAYMOVE)
+                                 : (char*)mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, npy->fd, 0);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "Error mapping activation dump\n");
+        return 0;
+    }
+
+    npy->mapping = mapping;
+    npy->mappedBytes = bytes;
+    npy->capacity = capacity;
+    return 1;
+}
+
+NpyFile* createNpyFile(const char* path, int ndim, const long* shape, int batched) {
+    NpyFile* npy = (NpyFile*)calloc(1, sizeof(NpyFile));
+    if (!npy) {
+        fprintf(stderr, "Memory allocation failed for activation dump\n");
+        exit(EXIT_FAILURE);
+    }
+
+    npy->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (npy->fd < 0) {
+        fprintf(stderr, "Error opening file: %s\n", path);
+        free(npy);
+        return NULL;
+    }
+
+    npy->ndim = ndim;
+    npy->signalFloats = 1;
+    for (int d = 0; d < ndim; d++) {
+        npy->shape[d] = shape[d];
+        npy->signalFloats *= shape[d];
+    }
+    npy->batched = batched;
+    npy->headerSize = formatNpyHeader(npy, LONG_MAX, NULL, 0);
+
+    if (!reserveNpySignals(npy, 1)) {
+        close(npy->fd);
+        free(npy);
+        return NULL;
+    }
+    return npy;
+}
+
+float* npySignalData(NpyFile* npy, long signal) {
+    return (float*)(npy->mapping + npy->headerSize) + signal * npy->signalFloats;
+}
+
+// Fixes up the header and trims the file to the signals actually written
+void closeNpyFile(NpyFile* npy) {
+    if (!npy) return;
+
+    long signals = npy->batched ? npy->signals : 1;
+    writeNpyHeader(npy);
+    munmap(npy->mapping, npy->mappedBytes);
+    if (ftruncate(npy->fd, npy->headerSize + signals * npy->signalFloats * sizeof(float)) != 0) {
+        fprintf(stderr, "Error truncating activation dump\n");
+    }
+    close(npy->fd);
+    free(npy);
+}
+
+// selection is "all" or a comma separated list like "conv1,pool3". Tensors
+// are <dir>/layer<N>_conv.npy and <dir>/layer<N>_pool.npy with shape
+// [signals,] filters of layer 1, ..., filters of layer N, length.
+ActivationDump* createActivationDump(const char* dir, const char* selection, const Model* model,
+                                     const Workspace* ws, int batched) {
+    ActivationDump* dump = (ActivationDump*)calloc(1, sizeof(ActivationDump));
+    if (!dump) {
+        fprintf(stderr, "Memory allocation failed for activation dump\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Error creating directory: %s\n", dir);
+        free(dump);
+        return NULL;
+    }
+
+    long shape[MAX_LAYERS + 1];
+    for (int l = 0; l < model->numLayers; l++) {
+        shape[l] = model->layers[l].filters->rows;
+
+        for (int kind = 0; kind < 2; kind++) {
+            const char* name = kind == 0 ? "conv" : "pool";
+            char token[32];
+            snprintf(token, sizeof(token), "%s%d", name, l + 1);
+
+            int selected = strcmp(selection, "all") == 0;
+            for (const char* p = selection; !selected && *p;) {
+                size_t length = strcspn(p, ",");
+                selected = length == strlen(token) && strncmp(p, token, length) == 0;
+                p += length;
+                if (*p == ',') p++;
+            }
+            if (!selected) continue;
+
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/layer%d_%s.npy", dir, l + 1, name);
+            shape[l + 1] = kind == 0 ? ws->convLength[l] : ws->poolLength[l];
+            NpyFile* npy = createNpyFile(path, l + 2, shape, batched);
+            if (!npy) return NULL;
+            if (kind == 0) {
+                dump->conv[l] = npy;
+            } else {
+                dump->pooled[l] = npy;
+            }
+        }
+    }
+
+    return dump;
+}
+
+// Makes room for count more signals after the current one
+int reserveActivationDump(ActivationDump* dump, long count) {
+    for (int l = 0; l < MAX_LAYERS; l++) {
+        if (dump->conv[l] && !reserveNpySignals(dump->conv[l], dump->signal + count)) return 0;
+        if (dump->pooled[l] && !reserveNpySignals(dump->pooled[l], dump->signal + count)) return 0;
+    }
+    return 1;
+}
+
+void closeActivationDump(ActivationDump* dump) {
+    if (!dump) return;
+    for (int l = 0; l < MAX_LAYERS; l++) {
+        if (dump->conv[l]) dump->conv[l]->signals = dump->signal;
+        if (dump->pooled[l]) dump->pooled[l]->signals = dump->signal;
+        closeNpyFile(dump->conv[l]);
+        closeNpyFile(dump->pooled[l]);
+    }
+    free(dump);
+}
+
+// Copies one chain's activations into its slot of the dump
+void dumpActivation(NpyFile* npy, long signal, long chain, const float* values, int length) {
+    memcpy(npySignalData(npy, signal) + chain * length, values, length * sizeof(float));
+}
+
+// Applies filter f of a layer to a row, followed by its bias and the layer's
+// activation unless activate is 0
+void convolveRow(const Layer* layer, int f, const float* input, float* output, int outputLength, int activate) {
+    const float* filter = layer->filters->data[f];
+    int filterLength = layer->filters->cols;
+    float bias = layer->biases->data[f][0];
+
+    for (int j = 0; j < outputLength; j++) {
+        const float* window = input + j * layer->stride;
+        float sum = 0;
+        for (int n = 0; n < filterLength; n++) {
+            sum += window[n] * filter[n];
+        }
+        output[j] = activate ? applyActivation(layer, sum + bias) : sum;
+    }
+}
+
+// Applies the PACK_WIDTH filters of one packed block to a row. Output row
+// lane (filter block * PACK_WIDTH + lane) starts at output + lane * outputLength.
+// Each lane sums its taps in the same order as convolveRow(), so results are
+// identical.
+void convolveBlock(const Layer* layer, const PackedLayer* packed, int block, const float* input,
+                   float* output, int outputLength, int activate) {
+    const float* weights = packed->weights + (size_t)block * packed->paddedLength * PACK_WIDTH;
+    const float* biases = packed->biases + block * PACK_WIDTH;
+    int lanes = layer->filters->rows - block * PACK_WIDTH;
+    if (lanes > PACK_WIDTH) lanes = PACK_WIDTH;
+
+    for (int j = 0; j < outputLength; j++) {
+        const float* window = input + j * layer->stride;
+        float sum[PACK_WIDTH] = {0};
+        for (int n = 0; n < packed->filterLength; n++) {
+            float x = window[n];
+            const float* tap = weights + n * PACK_WIDTH;
+            for (int lane = 0; lane < PACK_WIDTH; lane++) {
+                sum[lane] += x * tap[lane];
+            }
+        }
+        for (int lane = 0; lane < lanes; lane++) {
+            output[(size_t)lane * outputLength + j] = activate ? applyActivation(layer, sum[lane] + biases[lane])
+                                                               : sum[lane];
+        }
+    }
+}
+
+// The bias and activation convolveRow() skips with activate 0, applied in place
+void activateRow(const Layer* layer, int f, float* row, int length) {
+    float bias = layer->biases->data[f][0];
+    for (int j = 0; j < length; j++) {
+        row[j] = applyActivation(layer, row[j] + bias);
+    }
+}
+
+void maxPoolRow(const float* input, int poolCols, int stride, float* output, int outputLength) {
+    for (int j = 0; j < outputLength; j++) {
+        const float* window = input + j * stride;
+        float maxVal = -INFINITY;
+        for (int n = 0; n < poolCols; n++) {
+            if (window[n] > maxVal) {
+                maxVal = window[n];
+            }
+        }
+        output[j] = maxVal;
+    }
+}
+
+// Fills in the per-layer lengths for a single-row input using the same
+// formulas as convolve() and maxPool(). Returns 0 on invalid dimensions.
+int computeLayerLengths(const Model* model, int inputLength, Workspace* ws) {
+    int length = inputLength;
+    ws->inputLength = inputLength;
+    ws->numChains = 1;
+
+    for (int l = 0; l < model->numLayers; l++) {
+        const Layer* layer = &model->layers[l];
+        int convLength = ((length - layer->filters->cols) / layer->stride) + 1;
+        int poolRowsOut = ((1 - layer->poolRows) / layer->poolStride) + 1;
+        if (length < layer->filters->cols || convLength <= 0 || poolRowsOut != 1 || convLength < layer->poolCols) {
+            fprintf(stderr, "Invalid dimensions at layer %d for input length %d\n", l + 1, inputLength);
+            return 0;
+        }
+        int poolLength = ((convLength - layer->poolCols) / layer->poolStride) + 1;
+
+        ws->layerInputLength[l] = length;
+        ws->convLength[l] = convLength;
+        ws->poolLength[l] = poolLength;
+        ws->numChains *= layer->filters->rows;
+        length = poolLength;
+    }
+
+    ws->outputLength = length;
+    return 1;
+}
+
+Workspace* createWorkspace(const Model* model, int inputLength) {
+    Workspace* ws = (Workspace*)calloc(1, sizeof(Workspace));
+    if (!ws) {
+        fprintf(stderr, "Memory allocation failed for workspace\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (!computeLayerLengths(model, inputLength, ws)) {
+        free(ws);
+        return NULL;
+    }
+
+    for (int l = 0; l < model->numLayers; l++) {
+        size_t numFilters = model->layers[l].filters->rows;
+        ws->conv[l] = (float*)calloc(numFilters * ws->convLength[l], sizeof(float));
+        ws->pooled[l] = (float*)calloc(numFilters * ws->poolLength[l], sizeof(float));
+        if (!ws->conv[l] || !ws->pooled[l]) {
+            fprintf(stderr, "Memory allocation failed for workspace buffers\n");
+            exit(EXIT_FAILURE);
+        }
+        recordAllocation(numFilters * ws->convLength[l] * sizeof(float));
+        recordAllocation(numFilters * ws->poolLength[l] * sizeof(float));
+    }
+
+    return ws;
+}
+
+void freeWorkspace(Workspace* ws, const Model* model) {
+    if (!ws) return;
+    for (int l = 0; l < model->numLayers; l++) {
+        size_t numFilters = model->layers[l].filters->rows;
+        recordFree(numFilters * ws->convLength[l] * sizeof(float));
+        recordFree(numFilters * ws->poolLength[l] * sizeof(float));
+        free(ws->conv[l]);
+        free(ws->pooled[l]);
+    }
+    free(ws);
+}
+
+static const struct {
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+} counterEvents[NUM_COUNTERS] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"L1D misses", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                       (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {"LLC misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {"branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"task clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK}
+};
+
+// Opens every counter it can as one group so a single read() samples them
+// together. Returns NULL only if none could be opened.
+LayerCounters* openLayerCounters(void) {
+    LayerCounters* counters = (LayerCounters*)calloc(1, sizeof(LayerCounters));
+    if (!counters) {
+        fprintf(stderr, "Memory allocation failed for counters\n");
+        exit(EXIT_FAILURE);
+    }
+    counters->leader = -1;
+
+    for (int c = 0; c < NUM_COUNTERS; c++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = counterEvents[c].type;
+        attr.config = counterEvents[c].config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        counters->fds[c] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, counters->leader, 0);
+        if (counters->fds[c] < 0) {
+            fprintf(stderr, "Counter %s unavailable: %s\n", counterEvents[c].name, strerror(errno));
+            counters->slot[c] = -1;
+            continue;
+        }
+        if (counters->leader < 0) counters->leader = counters->fds[c];
+        counters->slot[c] = counters->numOpen++;
+    }
+
+    if (counters->leader < 0) {
+        free(counters);
+        return NULL;
+    }
+
+    // Back-to-back reads measure what reading itself adds (the software clock
+    // keeps running through the syscall); the cheapest of a few is kept
+    for (int c = 0; c < NUM_COUNTERS; c++) counters->overhead[c] = UINT64_MAX;
+    for (int i = 0; i < 64; i++) {
+        uint64_t before[NUM_COUNTERS];
+        uint64_t after[NUM_COUNTERS];
+        readLayerCounters(counters, before);
+        readLayerCounters(counters, after);
+        for (int c = 0; c < NUM_COUNTERS; c++) {
+            if (after[c] - before[c] < counters->overhead[c]) counters->overhead[c] = after[c] - before[c];
+        }
+    }
+    return counters;
+}
+
+// values receives NUM_COUNTERS current counts, 0 for unavailable counters
+void readLayerCounters(LayerCounters* counters, uint64_t* values) {
+    uint64_t buffer[3 + NUM_COUNTERS];
+    memset(values, 0, NUM_COUNTERS * sizeof(uint64_t));
+    if (read(counters->leader, buffer, sizeof(buffer)) < (ssize_t)((3 + counters->numOpen) * sizeof(uint64_t))) {
+        return;
+    }
+    if (buffer[2] < buffer[1]) counters->multiplexed = 1;
+    for (int c = 0; c < NUM_COUNTERS; c++) {
+        if (counters->slot[c] >= 0) values[c] = buffer[3 + counters->slot[c]];
+    }
+}
+
+// Reads the counters again and charges the difference from before to one
+// step of a layer that wrote outputs elements
+void addLayerCounters(LayerCounters* counters, int layer, CounterStep step, const uint64_t* before, long outputs) {
+    uint64_t after[NUM_COUNTERS];
+    readLayerCounters(counters, after);
+    for (int c = 0; c < NUM_COUNTERS; c++) {
+        uint64_t delta = after[c] - before[c];
+        counters->totals[layer][step][c] += delta > counters->overhead[c] ? delta - counters->overhead[c] : 0;
+    }
+    counters->outputs[layer][step] += outputs;
+}
+
+void printCounterRatio(FILE* file, const LayerCounters* counters, CounterKind kind, uint64_t count, double per) {
+    if (counters->slot[kind] < 0 || per <= 0) {
+        fprintf(file, " %10s", "n/a");
+    } else {
+        fprintf(file, " %10.3f", count / per);
+    }
+}
+
+void printLayerCounters(const LayerCounters* counters, const Model* model, FILE* file) {
+    static const char* stepNames[NUM_COUNTER_STEPS] = {"conv", "pool"};
+
+    fprintf(file, "\nPer-layer counters (per output element unless noted):\n");
+    fprintf(file, "%-5s %-4s %12s %10s %10s %10s %10s %10s %10s %10s\n", "layer", "step", "outputs", "ns",
+            "cycles", "instr", "IPC", "L1D miss", "LLC miss", "br miss");
+    for (int l = 0; l < model->numLayers; l++) {
+        for (int s = 0; s < NUM_COUNTER_STEPS; s++) {
+            const uint64_t* totals = counters->totals[l][s];
+            double outputs = (double)counters->outputs[l][s];
+            fprintf(file, "%-5d %-4s %12.0f", l + 1, stepNames[s], outputs);
+            printCounterRatio(file, counters, COUNTER_TASK_CLOCK, totals[COUNTER_TASK_CLOCK], outputs);
+            printCounterRatio(file, counters, COUNTER_CYCLES, totals[COUNTER_CYCLES], outputs);
+            printCounterRatio(file, counters, COUNTER_INSTRUCTIONS, totals[COUNTER_INSTRUCTIONS], outputs);
+            // IPC needs both counters
+            if (counters->slot[COUNTER_CYCLES] < 0) {
+                fprintf(file, " %10s", "n/a");
+            } else {
+                printCounterRatio(file, counters, COUNTER_INSTRUCTIONS, totals[COUNTER_INSTRUCTIONS],
+                                  (double)totals[COUNTER_CYCLES]);
+            }
+            printCounterRatio(file, counters, COUNTER_L1D_MISSES, totals[COUNTER_L1D_MISSES], outputs);
+            printCounterRatio(file, counters, COUNTER_LLC_MISSES, totals[COUNTER_LLC_MISSES], outputs);
+            printCounterRatio(file, counters, COUNTER_BRANCH_MISSES, totals[COUNTER_BRANCH_MISSES], outputs);
+            fputc('\n', file);
+        }
+    }
+    if (counters->multiplexed) {
+        fprintf(file, "Counters were multiplexed with other users of the PMU; counts are partial\n");
+    }
+}
+
+void closeLayerCounters(LayerCounters* counters) {
+    if (!counters) return;
+    for (int c = 0; c < NUM_COUNTERS; c++) {
+        if (counters->slot[c] >= 0) close(counters->fds[c]);
+    }
+    free(counters);
+}
+
+// Roofline analysis. estimateLayerWork() counts the FLOPs and the bytes each
+// kernel streams per inference, assuming every pass reads its operands and
+// writes its results once: a packed block reads the input once for
+// PACK_WIDTH filters, convolveRow() once per filter. Multiply-adds count as
+// two FLOPs, bias and activation as one each, a pooling comparison as one.
+// Reordered layers move bias and activation to the pooled values.
+void estimateLayerWork(const Model* model, const Workspace* ws, int l, CounterStep step, LayerWork* work) {
+    long calls = 1;
+    for (int p = 0; p < l; p++) calls *= model->layers[p].filters->rows;
+
+    const Layer* layer = &model->layers[l];
+    double filters = layer->filters->rows;
+    double taps = layer->filters->cols;
+    double inputLength = ws->layerInputLength[l];
+    double convLength = ws->convLength[l];
+    double poolLength = ws->poolLength[l];
+
+    double flops;
+    double bytes;
+    if (step == COUNTER_STEP_CONV) {
+        flops = filters * convLength * (2 * taps + (layer->activateAfterPool ? 0 : 2));
+        if (model->packed) {
+            const PackedLayer* packed = &model->packedLayers[l];
+            bytes = packed->numBlocks * (inputLength + (double)packed->paddedLength * PACK_WIDTH + PACK_WIDTH);
+        } else {
+            bytes = filters * (inputLength + taps + 1);
+        }
+        bytes = (bytes + filters * convLength) * sizeof(float);
+    } else {
+        flops = filters * poolLength * (layer->poolCols + (layer->activateAfterPool ? 2 : 0));
+        bytes = filters * (convLength + poolLength) * sizeof(float);
+    }
+
+    work->calls = calls;
+    work->flops = flops * calls;
+    work->bytes = bytes * calls;
+}
+
+volatile double probeSink;
+
+// Best of a few STREAM triad passes over three arrays of count doubles, in GB/s
+double measureTriad(long count, long passes) {
+    double* a = (double*)malloc(count * sizeof(double));
+    double* b = (double*)malloc(count * sizeof(double));
+    double* c = (double*)malloc(count * sizeof(double));
+    if (!a || !b || !c) {
+        fprintf(stderr, "Memory allocation failed for bandwidth probe\n");
+        exit(EXIT_FAILURE);
+    }
+    for (long i = 0; i < count; i++) {
+        a[i] = 0;
+        b[i] = 1;
+        c[i] = 2;
+    }
+
+    double best = 0;
+    for (int r = 0; r < 5; r++) {
+        long long start = traceNanoseconds();
+        for (long p = 0; p < passes; p++) {
+            for (long i = 0; i < count; i++) a[i] = b[i] + 3.0 * c[i];
+            probeSink = a[p % count];
+        }
+        double seconds = (traceNanoseconds() - start) / 1e9;
+        double rate = 3.0 * sizeof(double) * count * passes / seconds / 1e9;
+        if (rate > best) best = rate;
+    }
+
+    free(a);
+    free(b);
+    free(c);
+    return best;
+}
+
+// Peak float multiply-add rate of this build: enough independent chains to
+// hide latency, in whatever vector width the compiler chose
+#define PROBE_CHAINS 64
+
+double measureFmaPeak(void) {
+    float acc[PROBE_CHAINS];
+    for (int k = 0; k < PROBE_CHAINS; k++) acc[k] = (float)k;
+    float m = (float)probeSink + 0.999999f;
+    float c = 1e-7f;
+
+    long iterations = 1 << 20;
+    double best = 0;
+    for (int r = 0; r < 5; r++) {
+        long long start = traceNanoseconds();
+        for (long i = 0; i < iterations; i++) {
+            for (int k = 0; k < PROBE_CHAINS; k++) acc[k] = acc[k] * m + c;
+        }
+        double seconds = (traceNanoseconds() - start) / 1e9;
+        double rate = 2.0 * PROBE_CHAINS * iterations / seconds / 1e9;
+        if (rate > best) best = rate;
+    }
+
+    float sum = 0;
+    for (int k = 0; k < PROBE_CHAINS; k++) sum += acc[k];
+    probeSink = sum;
+    return best;
+}
+
+void measureMachinePeaks(MachinePeaks* peaks) {
+    peaks->gflops = measureFmaPeak();
+    peaks->cacheGBs = measureTriad(1024, 1 << 14);        // 24 KB, within L1/L2
+    peaks->memoryGBs = measureTriad(4L << 20, 4);         // 96 MB, beyond the LLC
+}
+
+// One row per layer step: analytic work, measured time per inference, the
+// rates achieved and the share of the roof they reach. The working sets of
+// this network fit in cache, so the cache triad bounds memory traffic; the
+// DRAM ridge is printed for inputs that do not.
+void printRoofline(const Model* model, const Workspace* ws, const LayerProfile* profile,
+                   const MachinePeaks* peaks, FILE* file) {
+    static const char* stepNames[NUM_COUNTER_STEPS] = {"conv", "pool"};
+    long inferences = profile->inferences > 0 ? profile->inferences : 1;
+
+    fprintf(file, "Machine: %.2f GFLOP/s peak (multiply-add probe), %.2f GB/s cache, %.2f GB/s DRAM (triad)\n",
+            peaks->gflops, peaks->cacheGBs, peaks->memoryGBs);
+    fprintf(file, "Ridge points: %.2f FLOP/byte against cache, %.2f against DRAM\n",
+            peaks->gflops / peaks->cacheGBs, peaks->gflops / peaks->memoryGBs);
+    fprintf(file, "Kernel: %s, %ld inferences of %d samples\n\n",
+            model->packed ? "packed convolveBlock" : "convolveRow", profile->inferences, ws->inputLength);
+
+    fprintf(file, "%-5s %-4s %6s %10s %10s %8s %10s %9s %9s %8s %7s\n", "layer", "step", "calls", "KFLOP",
+            "KB", "FLOP/B", "us", "GFLOP/s", "GB/s", "bound", "of roof");
+    for (int l = 0; l < model->numLayers; l++) {
+        for (int s = 0; s < NUM_COUNTER_STEPS; s++) {
+            LayerWork work;
+            estimateLayerWork(model, ws, l, (CounterStep)s, &work);
+            double seconds = profile->nanoseconds[l][s] / 1e9 / inferences;
+            double intensity = work.flops / work.bytes;
+            double gflops = seconds > 0 ? work.flops / seconds / 1e9 : 0;
+            double gbs = seconds > 0 ? work.bytes / seconds / 1e9 : 0;
+            double memoryRoof = intensity * peaks->cacheGBs;
+            int computeBound = memoryRoof >= peaks->gflops;
+            double roof = computeBound ? peaks->gflops : memoryRoof;
+            fprintf(file, "%-5d %-4s %6ld %10.1f %10.1f %8.2f %10.2f %9.2f %9.2f %8s %6.1f%%\n", l + 1,
+                    stepNames[s], work.calls, work.flops / 1e3, work.bytes / 1024, intensity, seconds * 1e6,
+                    gflops, gbs, computeBound ? "compute" : "memory", roof > 0 ? 100 * gflops / roof : 0);
+        }
+    }
+}
+
+// Writes this layer's outputs (and everything below it) for one input row and
+// returns the position after the last chain written. chain is the flat index
+// of the filter chain that produced input.
+float* inferLayer(const Model* model, Workspace* ws, int l, long chain, const float* input, float* output) {
+    const Layer* layer = &model->layers[l];
+    int last = l == model->numLayers - 1;
+    ActivationDump* dump = ws->dump;
+    int convLength = ws->convLength[l];
+    int poolLength = ws->poolLength[l];
+
+    // Convolve every filter of the layer first so a packed block streams the
+    // input once for PACK_WIDTH filters. The activation is applied inside the
+    // kernels, so the conv span covers bias and activation too, unless the
+    // layer was reordered to activate after pooling. Conv dumps need the
+    // activated values, so they keep the original order.
+    int activate = !layer->activateAfterPool || (dump && dump->conv[l]);
+    uint64_t span = traceBegin();
+    uint64_t before[NUM_COUNTERS];
+    long long started = ws->profile ? traceNanoseconds() : 0;
+    if (ws->counters) readLayerCounters(ws->counters, before);
+    if (model->packed) {
+        for (int b = 0; b < model->packedLayers[l].numBlocks; b++) {
+            convolveBlock(layer, &model->packedLayers[l], b, input,
+                          ws->conv[l] + (size_t)b * PACK_WIDTH * convLength, convLength, activate);
+        }
+    } else {
+        for (int f = 0; f < layer->filters->rows; f++) {
+            convolveRow(layer, f, input, ws->conv[l] + (size_t)f * convLength, convLength, activate);
+        }
+    }
+    traceEnd("conv", l, span);
+    if (ws->profile) ws->profile->nanoseconds[l][COUNTER_STEP_CONV] += traceNanoseconds() - started;
+    if (ws->counters) {
+        addLayerCounters(ws->counters, l, COUNTER_STEP_CONV, before, (long)layer->filters->rows * convLength);
+    }
+
+    // Likewise pool every filter before descending, so the pool step is one
+    // span and one counter sample per layer call. The last layer pools
+    // straight into output.
+    float* pooledRows = last ? output : ws->pooled[l];
+    span = traceBegin();
+    if (ws->profile) started = traceNanoseconds();
+    if (ws->counters) readLayerCounters(ws->counters, before);
+    for (int f = 0; f < layer->filters->rows; f++) {
+        maxPoolRow(ws->conv[l] + (size_t)f * convLength, layer->poolCols, layer->poolStride,
+                   pooledRows + (size_t)f * poolLength, poolLength);
+        if (!activate) activateRow(layer, f, pooledRows + (size_t)f * poolLength, poolLength);
+    }
+    traceEnd("pool", l, span);
+    if (ws->profile) ws->profile->nanoseconds[l][COUNTER_STEP_POOL] += traceNanoseconds() - started;
+    if (ws->counters) {
+        addLayerCounters(ws->counters, l, COUNTER_STEP_POOL, before, (long)layer->filters->rows * poolLength);
+    }
+
+    for (int f = 0; f < layer->filters->rows; f++) {
+        long current = chain * layer->filters->rows + f;
+        float* conv = ws->conv[l] + (size_t)f * convLength;
+        float* pooled = pooledRows + (size_t)f * poolLength;
+
+        if (dump && dump->conv[l]) {
+            dumpActivation(dump->conv[l], dump->signal, current, conv, convLength);
+        }
+        if (dump && dump->pooled[l]) {
+            dumpActivation(dump->pooled[l], dump->signal, current, pooled, poolLength);
+        }
+
+        if (last) {
+            output += poolLength;
+        } else {
+            output = inferLayer(model, ws, l + 1, current, pooled, output);
+        }
+    }
+
+    return output;
+}
+
+// output holds numChains * outputLength values, chains in filter order
+void inferWorkspace(const Model* model, Workspace* ws, const float* input, float* output) {
+    uint64_t span = traceBegin();
+    inferLayer(model, ws, 0, 0, input, output);
+    traceEnd("infer", -1, span);
+    if (ws->profile) ws->profile->inferences++;
+    if (ws->dump) ws->dump->signal++;
+}
+
+// Runs count signals of ws->inputLength values each; outputs are laid out
+// signal after signal, numChains * outputLength values per signal
+void inferBatch(const Model* model, Workspace* ws, const float* inputs, int count, float* outputs) {
+    size_t outputStride = (size_t)ws->numChains * ws->outputLength;
+    for (int i = 0; i < count; i++) {
+        inferWorkspace(model, ws, inputs + (size_t)i * ws->inputLength, outputs + i * outputStride);
+    }
+}
+
+// Fills ranges[l] with the input, conv and pooled values of layer l that the
+// last layer's pooled outputs [begin, end) depend on, walking back from the
+// last layer: a pooled range needs its pooling windows, a conv range its
+// filter windows, and layer l's input is layer l-1's pooled output.
+void computeTileRanges(const Model* model, int begin, int end, TileRange* ranges) {
+    for (int l = model->numLayers - 1; l >= 0; l--) {
+        const Layer* layer = &model->layers[l];
+        TileRange* range = &ranges[l];
+        range->poolBegin = begin;
+        range->poolEnd = end;
+        range->convBegin = begin * layer->poolStride;
+        range->convEnd = (end - 1) * layer->poolStride + layer->poolCols;
+        range->inputBegin = range->convBegin * layer->stride;
+        range->inputEnd = (range->convEnd - 1) * layer->stride + layer->filters->cols;
+        begin = range->inputBegin;
+        end = range->inputEnd;
+    }
+}
+
+// Sizes the tile buffers for the largest tile and counts the conv outputs
+// computed over all tiles, which exceed ws->convLength by the halos
+// neighbouring tiles both compute. tileLength is clamped to the output length.
+TileWorkspace* createTileWorkspace(const Model* model, const Workspace* ws, int tileLength) {
+    TileWorkspace* tw = (TileWorkspace*)calloc(1, sizeof(TileWorkspace));
+    if (!tw) {
+        fprintf(stderr, "Memory allocation failed for tile workspace\n");
+        exit(EXIT_FAILURE);
+    }
+    if (tileLength < 1 || tileLength > ws->outputLength) tileLength = ws->outputLength;
+    tw->tileLength = tileLength;
+    tw->numTiles = (ws->outputLength + tileLength - 1) / tileLength;
+
+    for (int t = 0; t < tw->numTiles; t++) {
+        TileRange ranges[MAX_LAYERS];
+        int begin = t * tileLength;
+        int end = begin + tileLength < ws->outputLength ? begin + tileLength : ws->outputLength;
+        computeTileRanges(model, begin, end, ranges);
+        for (int l = 0; l < model->numLayers; l++) {
+            int inputLength = ranges[l].inputEnd - ranges[l].inputBegin;
+            int convLength = ranges[l].convEnd - ranges[l].convBegin;
+            int poolLength = ranges[l].poolEnd - ranges[l].poolBegin;
+            if (inputLength > tw->inputLength[l]) tw->inputLength[l] = inputLength;
+            if (convLength > tw->convLength[l]) tw->convLength[l] = convLength;
+            if (poolLength > tw->poolLength[l]) tw->poolLength[l] = poolLength;
+            tw->convComputed[l] += convLength;
+        }
+    }
+
+    for (int l = 0; l < model->numLayers; l++) {
+        size_t numFilters = model->layers[l].filters->rows;
+        tw->conv[l] = (float*)calloc(numFilters * tw->convLength[l], sizeof(float));
+        tw->pooled[l] = (float*)calloc(numFilters * tw->poolLength[l], sizeof(float));
+        if (!tw->conv[l] || !tw->pooled[l]) {
+            fprintf(stderr, "Memory allocation failed for tile buffers\n");
+            exit(EXIT_FAILURE);
+        }
+        recordAllocation(numFilters * tw->convLength[l] * sizeof(float));
+        recordAllocation(numFilters * tw->poolLength[l] * sizeof(float));
+    }
+
+    return tw;
+}
+
+void freeTileWorkspace(TileWorkspace* tw, const Model* model) {
+    if (!tw) return;
+    for (int l = 0; l < model->numLayers; l++) {
+        size_t numFilters = model->layers[l].filters->rows;
+        recordFree(numFilters * tw->convLength[l] * sizeof(float));
+        recordFree(numFilters * tw->poolLength[l] * sizeof(float));
+        free(tw->conv[l]);
+        free(tw->pooled[l]);
+    }
+    free(tw);
+}
+
+// Bytes a layer works on at once, its input row plus its conv and pooled rows
+// for every filter; the last layer pools into the output instead
+double workingSetBytes(const Model* model, int l, int inputLength, int convLength, int poolLength) {
+    double filters = model->layers[l].filters->rows;
+    double pooled = l == model->numLayers - 1 ? 0 : filters * poolLength;
+    return (inputLength + filters * convLength + pooled) * sizeof(float);
+}
+
+// Largest tile whose layers each work on at most cacheBytes, or 1 if even a
+// single output does not fit
+int chooseTileLength(const Model* model, const Workspace* ws, long cacheBytes) {
+    int best = 1;
+    for (int tileLength = 1; tileLength <= ws->outputLength; tileLength++) {
+        TileRange ranges[MAX_LAYERS];
+        computeTileRanges(model, 0, tileLength, ranges);
+        int fits = 1;
+        for (int l = 0; l < model->numLayers; l++) {
+            fits &= workingSetBytes(model, l, ranges[l].inputEnd - ranges[l].inputBegin,
+                                    ranges[l].convEnd - ranges[l].convBegin,
+                                    ranges[l].poolEnd - ranges[l].poolBegin) <= cacheBytes;
+        }
+        if (!fits) break;
+        best = tileLength;
+    }
+    return best;
+}
+
+// One tile of inferLayer(): input starts at ranges[l].inputBegin of the full
+// row. The last layer pools straight into each chain's output row.
+void inferTileLayer(const Model* model, const Workspace* ws, TileWorkspace* tw, const TileRange* ranges,
+                    int l, long chain, const float* input, float* output) {
+    const Layer* layer = &model->layers[l];
+    int last = l == model->numLayers - 1;
+    int activate = !layer->activateAfterPool;
+    int convLength = ranges[l].convEnd - ranges[l].convBegin;
+    int poolLength = ranges[l].poolEnd - ranges[l].poolBegin;
+
+    if (model->packed) {
+        for (int b = 0; b < model->packedLayers[l].numBlocks; b++) {
+            convolveBlock(layer, &model->packedLayers[l], b, input,
+                          tw->conv[l] + (size_t)b * PACK_WIDTH * convLength, convLength, activate);
+        }
+    } else {
+        for (int f = 0; f < layer->filters->rows; f++) {
+            convolveRow(layer, f, input, tw->conv[l] + (size_t)f * convLength, convLength, activate);
+        }
+    }
+
+    for (int f = 0; f < layer->filters->rows; f++) {
+        long current = chain * layer->filters->rows + f;
+        float* pooled = last ? output + current * ws->outputLength + ranges[l].poolBegin
+                             : tw->pooled[l] + (size_t)f * poolLength;
+        maxPoolRow(tw->conv[l] + (size_t)f * convLength, layer->poolCols, layer->poolStride, pooled, poolLength);
+        if (!activate) activateRow(layer, f, pooled, poolLength);
+        if (!last) inferTileLayer(model, ws, tw, ranges, l + 1, current, pooled, output);
+    }
+}
+
+// Depth-first inferWorkspace(): each tile of the last layer's output is
+// computed through every layer before the next tile starts, so each layer's
+// intermediates are tile-sized rather than row-sized. Outputs are identical
+// to inferWorkspace(). Dumps, counters and profiles are not supported.
+void inferTiled(const Model* model, const Workspace* ws, TileWorkspace* tw, const float* input, float* output) {
+    uint64_t span = traceBegin();
+    for (int t = 0; t < tw->numTiles; t++) {
+        TileRange ranges[MAX_LAYERS];
+        int begin = t * tw->tileLength;
+        int end = begin + tw->tileLength < ws->outputLength ? begin + tw->tileLength : ws->outputLength;
+        computeTileRanges(model, begin, end, ranges);
+        inferTileLayer(model, ws, tw, ranges, 0, 0, input + ranges[0].inputBegin, output);
+    }
+    traceEnd("infer tiled", -1, span);
+}
+
+// Intermediate traffic per inference: each conv value is written and read
+// back by pooling, each pooled value written and read by the next layer. A
+// layer's traffic counts as leaving L1 when its working set does not fit in
+// cacheBytes, for whole rows layer by layer and for the largest tile
+// depth-first. Tiling trades that traffic for recomputing the halos; the
+// extra conv column can go negative because rows also compute the trailing
+// conv values no pooling window reads.
+void printTileTraffic(const Model* model, const Workspace* ws, const TileWorkspace* tw, long cacheBytes, FILE* out) {
+    fprintf(out, "depth-first tiling: %d tile%s of %d outputs per chain, %ld KB L1D\n",
+            tw->numTiles, tw->numTiles == 1 ? "" : "s", tw->tileLength, cacheBytes / 1024);
+    fprintf(out, "%-6s %14s %14s %14s %14s %14s %14s %11s\n", "layer", "row set KB", "tile set KB",
+            "row KB/inf", "tiled KB/inf", "row >L1", "tiled >L1", "extra conv");
+
+    double rowTotal = 0, tiledTotal = 0, rowSpill = 0, tiledSpill = 0;
+    long calls = 1;
+    for (int l = 0; l < model->numLayers; l++) {
+        double filters = model->layers[l].filters->rows;
+        int last = l == model->numLayers - 1;
+        double rowSet = workingSetBytes(model, l, ws->layerInputLength[l], ws->convLength[l], ws->poolLength[l]);
+        double tileSet = workingSetBytes(model, l, tw->inputLength[l], tw->convLength[l], tw->poolLength[l]);
+        double pooledTraffic = last ? 0 : 2.0 * ws->poolLength[l];
+        double rowBytes = calls * filters * (2.0 * ws->convLength[l] + pooledTraffic) * sizeof(float);
+        double tiledBytes = calls * filters * (2.0 * tw->convComputed[l] + pooledTraffic) * sizeof(float);
+        double rowBeyond = rowSet > cacheBytes ? rowBytes : 0;
+        double tiledBeyond = tileSet > cacheBytes ? tiledBytes : 0;
+
+        fprintf(out, "%-6d %14.1f %14.1f %14.1f %14.1f %14.1f %14.1f %10.1f%%\n", l + 1, rowSet / 1024,
+                tileSet / 1024, rowBytes / 1024, tiledBytes / 1024, rowBeyond / 1024, tiledBeyond / 1024,
+                100.0 * (tw->convComputed[l] - ws->convLength[l]) / ws->convLength[l]);
+        rowTotal += rowBytes;
+        tiledTotal += tiledBytes;
+        rowSpill += rowBeyond;
+        tiledSpill += tiledBeyond;
+        calls *= model->layers[l].filters->rows;
+    }
+
+    fprintf(out, "%-6s %14s %14s %14.1f %14.1f %14.1f %14.1f\n", "total", "", "", rowTotal / 1024,
+            tiledTotal / 1024, rowSpill / 1024, tiledSpill / 1024);
+    fprintf(out, "traffic beyond L1 saved: %.1f KB per inference", (rowSpill - tiledSpill) / 1024);
+    if (rowSpill > 0) fprintf(out, " (%.1f%%)", 100.0 * (rowSpill - tiledSpill) / rowSpill);
+    fprintf(out, "\n");
+}
+
+// Trace buffers are allocated on a thread's first span after tracing starts
+// and pushed onto a lock-free list; only the owning thread appends, publishing
+// each event with a release store of count, so a writer can export while
+// workers run. Buffers are kept until exit because threads hold them in TLS.
+typedef struct TraceBuffer {
+    struct TraceBuffer* next;
+    int threadIndex;
+    long capacity;
+    atomic_long count;
+    atomic_long dropped;   // spans that did not fit
+    TraceEvent events[];
+} TraceBuffer;
+
+atomic_int traceEnabled;
+static _Atomic(TraceBuffer*) traceBuffers;
+static atomic_int traceThreads;
+static atomic_long traceCapacity;
+static __thread TraceBuffer* traceBuffer;
+
+// Clock pairs taken at start and export convert TSC ticks to microseconds
+static uint64_t traceStartTicks;
+static long long traceStartNanoseconds;
+
+uint64_t traceClock(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+long long traceNanoseconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void traceRecord(const char* name, int layer, uint64_t begin) {
+    uint64_t end = traceClock();
+    TraceBuffer* buffer = traceBuffer;
+    if (!buffer) {
+        long capacity = atomic_load(&traceCapacity);
+        buffer = (TraceBuffer*)malloc(sizeof(TraceBuffer) + capacity * sizeof(TraceEvent));
+        if (!buffer) {
+            fprintf(stderr, "Memory allocation failed for trace buffer\n");
+            exit(EXIT_FAILURE);
+        }
+        buffer->threadIndex = atomic_fetch_add(&traceThreads, 1) + 1;
+        buffer->capacity = capacity;
+        atomic_init(&buffer->count, 0);
+        atomic_init(&buffer->dropped, 0);
+        buffer->next = atomic_load(&traceBuffers);
+        while (!atomic_compare_exchange_weak(&traceBuffers, &buffer->next, buffer)) {
+        }
+        traceBuffer = buffer;
+    }
+
+    long count = atomic_load_explicit(&buffer->count, memory_order_relaxed);
+    if (count == buffer->capacity) {
+        atomic_fetch_add_explicit(&buffer->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    TraceEvent* event = &buffer->events[count];
+    event->name = name;
+    event->layer = layer;
+    event->begin = begin;
+    event->end = end;
+    atomic_store_explicit(&buffer->count, count + 1, memory_order_release);
+}
+
+// Starts a new trace, discarding events already recorded. Threads that have
+// a buffer keep its capacity; eventsPerThread applies to new threads. Must not
+// race with spans still being recorded from an earlier trace.
+void startTracing(long eventsPerThread) {
+    atomic_store(&traceCapacity, eventsPerThread > 0 ? eventsPerThread : 1 << 16);
+    for (TraceBuffer* b = atomic_load(&traceBuffers); b; b = b->next) {
+        atomic_store(&b->count, 0);
+        atomic_store(&b->dropped, 0);
+    }
+    traceStartNanoseconds = traceNanoseconds();
+    traceStartTicks = traceClock();
+    atomic_store(&traceEnabled, 1);
+}
+
+void stopTracing(void) {
+    atomic_store(&traceEnabled, 0);
+}
+
+// Writes every recorded span as a Chrome trace-event "complete" event, loadable
+// in chrome://tracing and Perfetto. Tracing may still be running.
+int writeChromeTrace(const char* filename) {
+    // Calibrate over at least a millisecond so the tick rate is meaningful
+    long long elapsed;
+    uint64_t ticks;
+    do {
+        elapsed = traceNanoseconds() - traceStartNanoseconds;
+        ticks = traceClock() - traceStartTicks;
+    } while (elapsed < 1000000);
+    double ticksPerMicrosecond = ticks / (elapsed / 1e3);
+
+    FILE* file = fopen(filename, "w");
+    if (!file) {
+        fprintf(stderr, "Error opening file: %s\n", filename);
+        return 0;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    int first = 1;
+    long dropped = 0;
+    for (TraceBuffer* b = atomic_load(&traceBuffers); b; b = b->next) {
+        long count = atomic_load_explicit(&b->count, memory_order_acquire);
+        dropped += atomic_load(&b->dropped);
+        fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                      "\"args\": {\"name\": \"thread %d\"}}", first ? "" : ",\n", b->threadIndex, b->threadIndex);
+        first = 0;
+        for (long i = 0; i < count; i++) {
+            const TraceEvent* e = &b->events[i];
+            // Events from before a restart of tracing are not kept, but a
+            // span begun just before it may predate traceStartTicks
+            double ts = e->begin >= traceStartTicks ? (e->begin - traceStartTicks) / ticksPerMicrosecond : 0.0;
+            double dur = (e->end - e->begin) / ticksPerMicrosecond;
+            fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f",
+                    e->name, b->threadIndex, ts, dur);
+            if (e->layer >= 0) {
+                fprintf(file, ", \"args\": {\"layer\": %d}", e->layer + 1);
+            }
+            fputc('}', file);
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    if (dropped) {
+        fprintf(stderr, "Trace buffers were full, %ld spans dropped\n", dropped);
+    }
+    return fclose(file) == 0;
+}
+
+// Engine handles for libcnn.h. The model is read-only after loading, so
+// threads share it freely; each call borrows a workspace for its input length
+// from a small pool, the lock only guarding the pool itself.
+struct CnnEngine {
+    Model model;
+    pthread_mutex_t lock;
+    Workspace** idle;      // workspaces not in use by any call
+    int idleCount;
+    int idleCapacity;
+};
+
+CnnEngine* createEngine(void) {
+    CnnEngine* engine = (CnnEngine*)calloc(1, sizeof(CnnEngine));
+    if (!engine) {
+        fprintf(stderr, "Memory allocation failed for engine\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_init(&engine->lock, NULL);
+    return engine;
+}
+
+CnnEngine* cnnEngineOpen(const char* modelFile) {
+    if (!modelFile) return NULL;
+    uint64_t span = traceBegin();
+    CnnEngine* engine = createEngine();
+    if (!loadModelBinary(&engine->model, modelFile)) {
+        pthread_mutex_destroy(&engine->lock);
+        free(engine);
+        return NULL;
+    }
+    packModel(&engine->model);
+    traceEnd("load model", -1, span);
+    return engine;
+}
+
+CnnEngine* cnnEngineOpenCSV(int numLayers, const char** filterFiles, const char** biasFiles,
+                            int stride, int poolRows, int poolCols, int poolStride) {
+    if (numLayers <= 0 || !filterFiles || !biasFiles || stride <= 0 || poolStride <= 0) return NULL;
+    uint64_t span = traceBegin();
+    CnnEngine* engine = createEngine();
+    if (!loadModelFromCSV(&engine->model, numLayers, filterFiles, biasFiles, stride, poolRows, poolCols, poolStride)) {
+        pthread_mutex_destroy(&engine->lock);
+        free(engine);
+        return NULL;
+    }
+    packModel(&engine->model);
+    traceEnd("load model", -1, span);
+    return engine;
+}
+
+void cnnEngineFree(CnnEngine* engine) {
+    if (!engine) return;
+    for (int i = 0; i < engine->idleCount; i++) {
+        freeWorkspace(engine->idle[i], &engine->model);
+    }
+    free(engine->idle);
+    freeModel(&engine->model);
+    pthread_mutex_destroy(&engine->lock);
+    free(engine);
+}
+
+// Takes an idle workspace for inputLength or creates one. Returns NULL if the
+// model cannot take that length.
+Workspace* acquireWorkspace(CnnEngine* engine, int inputLength) {
+    Workspace* ws = NULL;
+    pthread_mutex_lock(&engine->lock);
+    for (int i = 0; i < engine->idleCount; i++) {
+        if (engine->idle[i]->inputLength == inputLength) {
+            ws = engine->idle[i];
+            engine->idle[i] = engine->idle[--engine->idleCount];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&engine->lock);
+    return ws ? ws : createWorkspace(&engine->model, inputLength);
+}
+
+void releaseWorkspace(CnnEngine* engine, Workspace* ws) {
+    pthread_mutex_lock(&engine->lock);
+    if (engine->idleCount == engine->idleCapacity) {
+        engine->idleCapacity = engine->idleCapacity ? engine->idleCapacity * 2 : 8;
+        engine->idle = (Workspace**)realloc(engine->idle, engine->idleCapacity * sizeof(Workspace*));
+        if (!engine->idle) {
+            fprintf(stderr, "Memory allocation failed for workspace pool\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    engine->idle[engine->idleCount++] = ws;
+    pthread_mutex_unlock(&engine->lock);
+}
+
+long cnnEngineOutputSize(const CnnEngine* engine, int inputLength) {
+    if (!engine || inputLength <= 0) return CNN_ERROR_ARGUMENT;
+    // Only the shapes are needed, so no buffers and no pooled workspace
+    Workspace shapes;
+    memset(&shapes, 0, sizeof(shapes));
+    if (!computeLayerLengths(&engine->model, inputLength, &shapes)) return CNN_ERROR_INPUT_LENGTH;
+    return (long)shapes.numChains * shapes.outputLength;
+}
+
+int cnnEngineInfer(CnnEngine* engine, const float* input, int inputLength,
+                   float* output, size_t outputCapacity) {
+    return cnnEngineInferBatch(engine, input, 1, inputLength, output, outputCapacity);
+}
+
+int cnnEngineInferBatch(CnnEngine* engine, const float* inputs, int count, int inputLength,
+                        float* outputs, size_t outputCapacity) {
+    if (!engine || !inputs || !outputs || count <= 0 || inputLength <= 0) return CNN_ERROR_ARGUMENT;
+
+    Workspace* ws = acquireWorkspace(engine, inputLength);
+    if (!ws) return CNN_ERROR_INPUT_LENGTH;
+
+    int status = CNN_OK;
+    if ((size_t)count * ws->numChains * ws->outputLength > outputCapacity) {
+        status = CNN_ERROR_OUTPUT_SIZE;
+    } else {
+        inferBatch(&engine->model, ws, inputs, count, outputs);
+    }
+    releaseWorkspace(engine, ws);
+    return status;
+}
+
+int cnnEngineInferReference(CnnEngine* engine, const float* input, int inputLength,
+                            float* output, size_t outputCapacity) {
+    if (!engine || !input || !output || inputLength <= 0) return CNN_ERROR_ARGUMENT;
+    long outputSize = cnnEngineOutputSize(engine, inputLength);
+    if (outputSize < 0) return CNN_ERROR_INPUT_LENGTH;
+    if ((size_t)outputSize > outputCapacity) return CNN_ERROR_OUTPUT_SIZE;
+    return inferReference(&engine->model, input, inputLength, output) ? CNN_OK : CNN_ERROR_ARGUMENT;
+}
+
+// Execution contexts for libcnn.h: the scratch buffers and counters of one
+// thread. Everything a context touches is its own or the read-only model, so
+// inference through a context takes no lock.
+struct CnnContext {
+    const Model* model;
+    Workspace* ws;
+    CnnContextStats stats;
+};
+
+CnnContext* cnnContextCreate(const CnnEngine* engine, int inputLength) {
+    if (!engine || inputLength <= 0) return NULL;
+    Workspace* ws = createWorkspace(&engine->model, inputLength);
+    if (!ws) return NULL;
+
+    CnnContext* context = (CnnContext*)calloc(1, sizeof(CnnContext));
+    if (!context) {
+        fprintf(stderr, "Memory allocation failed for context\n");
+        exit(EXIT_FAILURE);
+    }
+    context->model = &engine->model;
+    context->ws = ws;
+    return context;
+}
+
+void cnnContextFree(CnnContext* context) {
+    if (!context) return;
+    freeWorkspace(context->ws, context->model);
+    free(context);
+}
+
+long cnnContextOutputSize(const CnnContext* context) {
+    if (!context) return CNN_ERROR_ARGUMENT;
+    return (long)context->ws->numChains * context->ws->outputLength;
+}
+
+int cnnContextInfer(CnnContext* context, const float* input, float* output, size_t outputCapacity) {
+    return cnnContextInferBatch(context, input, 1, output, outputCapacity);
+}
+
+int cnnContextInferBatch(CnnContext* context, const float* inputs, int count, float* outputs, size_t outputCapacity) {
+    if (!context || !inputs || !outputs || count <= 0) return CNN_ERROR_ARGUMENT;
+    if ((size_t)count * context->ws->numChains * context->ws->outputLength > outputCapacity) {
+        return CNN_ERROR_OUTPUT_SIZE;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    inferBatch(context->model, context->ws, inputs, count, outputs);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    context->stats.calls++;
+    context->stats.signals += count;
+    context->stats.nanoseconds += (end.tv_sec - start.tv_sec) * 1000000000ULL + end.tv_nsec - start.tv_nsec;
+    return CNN_OK;
+}
+
+void cnnContextGetStats(const CnnContext* context, CnnContextStats* stats) {
+    if (!context || !stats) return;
+    *stats = context->stats;
+}
+
+void cnnTraceStart(long eventsPerThread) {
+    startTracing(eventsPerThread);
+}
+
+void cnnTraceStop(void) {
+    stopTracing();
+}
+
+int cnnTraceWrite(const char* filename) {
+    if (!filename) return CNN_ERROR_ARGUMENT;
+    return writeChromeTrace(filename) ? CNN_OK : CNN_ERROR_IO;
+}
+
+void cnnGetAllocationStats(CnnAllocationStats* stats) {
+    if (!stats) return;
+    AllocationStats current;
+    getAllocationStats(&current);
+    memset(stats, 0, sizeof(*stats));
+    stats->allocations = current.allocations;
+    stats->frees = current.frees;
+    stats->bytes = current.bytes;
+    stats->liveBytes = current.liveBytes;
+    stats->peakBytes = current.peakBytes;
+    for (int l = 0; l < MAX_LAYERS && l < CNN_MAX_LAYERS; l++) {
+        stats->layerAllocations[l] = current.layerAllocations[l];
+        stats->layerBytes[l] = current.layerBytes[l];
+        stats->layerPeakBytes[l] = current.layerPeakBytes[l];
+    }
+}
+
+void cnnResetAllocationPeak(void) {
+    resetAllocationPeak();
+}
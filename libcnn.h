@@ -0,0 +1,130 @@
+#ifndef LIBCNN_H
+#define LIBCNN_H
+
+// C interface to the filter chain network, built as a shared library with
+//
+//   gcc -O2 -fPIC -shared -fvisibility=hidden -o libcnn.so libcnn.c -lm -lpthread
+//
+// An engine holds one loaded and prepacked model: open it once, infer as
+// often as needed, free it. The model is never modified after loading, so
+// one engine may be used by any number of threads at once. For the lowest
+// overhead, give each thread its own CnnContext (scratch buffers and
+// counters for one signal length); inference through a context takes no
+// lock. Inputs and outputs are caller-owned buffers read and written in
+// place. Allocation failures abort the process, as in the rest of the code.
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define CNN_API __attribute__((visibility("default")))
+#else
+#define CNN_API
+#endif
+
+#define CNN_OK 0
+#define CNN_ERROR_ARGUMENT -1       // NULL pointer or non-positive count
+#define CNN_ERROR_INPUT_LENGTH -2   // the model cannot take signals of this length
+#define CNN_ERROR_OUTPUT_SIZE -3    // output buffer smaller than the result
+#define CNN_ERROR_IO -4             // a file could not be written
+
+#define CNN_MAX_LAYERS 8
+
+typedef struct CnnEngine CnnEngine;
+typedef struct CnnContext CnnContext;
+
+typedef struct {
+    unsigned long long calls;         // successful infer calls
+    unsigned long long signals;       // signals inferred
+    unsigned long long nanoseconds;   // time spent inferring
+} CnnContextStats;
+
+// Opens a binary model written by 3rdlayer --convert-model. Returns NULL on
+// failure.
+CNN_API CnnEngine* cnnEngineOpen(const char* modelFile);
+
+// Builds a leaky relu model from one filter and one bias CSV per layer, all
+// layers sharing the same stride and pooling. Returns NULL on failure.
+CNN_API CnnEngine* cnnEngineOpenCSV(int numLayers, const char** filterFiles, const char** biasFiles,
+                                    int stride, int poolRows, int poolCols, int poolStride);
+
+CNN_API void cnnEngineFree(CnnEngine* engine);
+
+// Values written per signal of inputLength samples (filter chains times
+// final length, chains in filter order), or CNN_ERROR_INPUT_LENGTH
+CNN_API long cnnEngineOutputSize(const CnnEngine* engine, int inputLength);
+
+// Runs one signal. outputCapacity is the size of output in floats.
+CNN_API int cnnEngineInfer(CnnEngine* engine, const float* input, int inputLength,
+                           float* output, size_t outputCapacity);
+
+// Runs count signals stored back to back in inputs; results are stored back
+// to back in outputs, cnnEngineOutputSize() values each
+CNN_API int cnnEngineInferBatch(CnnEngine* engine, const float* inputs, int count, int inputLength,
+                                float* outputs, size_t outputCapacity);
+
+// Runs one signal through the original allocate-per-step pipeline (separate
+// convolve and max pool passes on freshly allocated matrices). Results match
+// cnnEngineInfer(); it exists as a slow reference for checking and measuring
+// the optimized path. Needs a model whose layers are all 0.1 leaky relu, as
+// the CSV models are, and returns CNN_ERROR_ARGUMENT otherwise.
+CNN_API int cnnEngineInferReference(CnnEngine* engine, const float* input, int inputLength,
+                                    float* output, size_t outputCapacity);
+
+// Creates a context for signals of inputLength samples. A context must not be
+// used by two threads at once and must be freed before its engine. Returns
+// NULL if the model cannot take that length.
+CNN_API CnnContext* cnnContextCreate(const CnnEngine* engine, int inputLength);
+
+CNN_API void cnnContextFree(CnnContext* context);
+
+// Values written per signal
+CNN_API long cnnContextOutputSize(const CnnContext* context);
+
+CNN_API int cnnContextInfer(CnnContext* context, const float* input, float* output, size_t outputCapacity);
+
+CNN_API int cnnContextInferBatch(CnnContext* context, const float* inputs, int count,
+                                 float* outputs, size_t outputCapacity);
+
+CNN_API void cnnContextGetStats(const CnnContext* context, CnnContextStats* stats);
+
+// Allocation accounting for the calling thread: matrices and inference
+// buffers allocated by the library, with the share made while computing each
+// layer. Peaks are high-water marks of live bytes since the last reset, so
+// resetting before an inference measures that inference's peak.
+typedef struct {
+    unsigned long long allocations;
+    unsigned long long frees;
+    unsigned long long bytes;                        // allocated in total
+    long long liveBytes;                             // allocated minus freed
+    long long peakBytes;
+    unsigned long long layerAllocations[CNN_MAX_LAYERS];
+    unsigned long long layerBytes[CNN_MAX_LAYERS];
+    long long layerPeakBytes[CNN_MAX_LAYERS];
+} CnnAllocationStats;
+
+CNN_API void cnnGetAllocationStats(CnnAllocationStats* stats);
+
+CNN_API void cnnResetAllocationPeak(void);
+
+// Tracing of model loading and of each layer's convolution (with bias and
+// activation) and pooling, process-wide and off by default. Each thread
+// records into its own buffer of eventsPerThread spans (0 for the default);
+// spans past that are dropped. Starting again discards earlier spans and must
+// not overlap inference still recording into the previous trace.
+CNN_API void cnnTraceStart(long eventsPerThread);
+
+CNN_API void cnnTraceStop(void);
+
+// Writes the spans recorded so far as Chrome trace-event JSON, viewable in
+// chrome://tracing or ui.perfetto.dev. May be called while tracing runs.
+CNN_API int cnnTraceWrite(const char* filename);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
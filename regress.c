@@ -0,0 +1,404 @@
+// Golden-output and performance regression check for the inference backends.
+// Build with
+//
+//   gcc -O2 -o regress regress.c libcnn.c -lm -lpthread
+//
+//   regress [--model file] [--input csv] [--signals N] [--seed N] [--ulp N]
+//           [--abs x] [--reps N] [--baseline file] [--save-baseline file]
+//           [--slowdown percent]
+//
+// Every backend runs on the same datasets: the --input CSV (test.csv by
+// default, skipped if missing) and synthetic signals of 1800 and 18000
+// samples. Outputs are compared with the reference convolve()/maxPool()
+// pipeline; a value passes when it is within --ulp units in the last place or
+// --abs of the reference. Timings are the median ns per signal over --reps
+// samples, each repeating the dataset for at least 50 ms. With --baseline, a
+// backend more than --slowdown percent slower than the stored time fails;
+// --save-baseline writes the current times.
+//
+// Exit status: 0 pass, 1 accuracy failure, 2 performance regression, 3 both,
+// and 4 for a setup or I/O error such as bad arguments or an unreadable model
+// or baseline. A failed --save-baseline adds 4 to the status of the run.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "cnncore.h"
+
+#define REGRESS_MAX_ENTRIES 64
+#define REGRESS_MIN_SAMPLE_NS 50000000LL
+#define REGRESS_SETUP_FAILED 4
+
+typedef void (*BackendFn)(const Model* model, Workspace* ws, const float* inputs, int count, float* outputs);
+
+typedef struct {
+    const char* name;
+    BackendFn run;
+} Backend;
+
+typedef struct {
+    char name[64];
+    float* signals;
+    int count;
+    int length;
+} Dataset;
+
+typedef struct {
+    char dataset[64];
+    char backend[64];
+    double nsPerSignal;
+} TimingEntry;
+
+void runReferenceBackend(const Model* model, Workspace* ws, const float* inputs, int count, float* outputs) {
+    size_t outputStride = (size_t)ws->numChains * ws->outputLength;
+    for (int i = 0; i < count; i++) {
+        if (!inferReference(model, inputs + (size_t)i * ws->inputLength, ws->inputLength, outputs + i * outputStride)) {
+            fprintf(stderr, "The reference pipeline needs a model of 0.1 leaky relu layers\n");
+            exit(REGRESS_SETUP_FAILED);
+        }
+    }
+}
+
+// One filter at a time through convolveRow()
+void runRowsBackend(const Model* model, Workspace* ws, const float* inputs, int count, float* outputs) {
+    Model unpacked = *model;
+    unpacked.packed = 0;
+    size_t outputStride = (size_t)ws->numChains * ws->outputLength;
+    for (int i = 0; i < count; i++) {
+        inferWorkspace(&unpacked, ws, inputs + (size_t)i * ws->inputLength, outputs + i * outputStride);
+    }
+}
+
+// PACK_WIDTH filters at a time through convolveBlock()
+void runPackedBackend(const Model* model, Workspace* ws, const float* inputs, int count, float* outputs) {
+    size_t outputStride = (size_t)ws->numChains * ws->outputLength;
+    for (int i = 0; i < count; i++) {
+        inferWorkspace(model, ws, inputs + (size_t)i * ws->inputLength, outputs + i * outputStride);
+    }
+}
+
+void runBatchBackend(const Model* model, Workspace* ws, const float* inputs, int count, float* outputs) {
+    inferBatch(model, ws, inputs, count, outputs);
+}
+
+// Packed, with bias and activation back in front of pooling on every layer
+void runNoReorderBackend(const Model* model, Workspace* ws, const float* inputs, int count, float* outputs) {
+    Model original = *model;
+    for (int l = 0; l < original.numLayers; l++) original.layers[l].activateAfterPool = 0;
+    size_t outputStride = (size_t)ws->numChains * ws->outputLength;
+    for (int i = 0; i < count; i++) {
+        inferWorkspace(&original, ws, inputs + (size_t)i * ws->inputLength, outputs + i * outputStride);
+    }
+}
+
+// The first entry is the reference the others are checked against; new
+// backends are added here
+static const Backend backends[] = {
+    {"reference", runReferenceBackend},
+    {"rows", runRowsBackend},
+    {"packed", runPackedBackend},
+    {"batch", runBatchBackend},
+    {"no-reorder", runNoReorderBackend}
+};
+
+#define NUM_BACKENDS ((int)(sizeof(backends) / sizeof(backends[0])))
+
+long long regressNanoseconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Maps floats onto integers whose difference is the ULP distance
+int64_t orderedFloat(float x) {
+    int32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits < 0 ? (int64_t)INT32_MIN - bits : bits;
+}
+
+int64_t ulpDistance(float a, float b) {
+    int64_t d = orderedFloat(a) - orderedFloat(b);
+    return d < 0 ? -d : d;
+}
+
+// Reads the entries written by writeBaseline(), one per line. Returns the
+// number read, or -1 if the file cannot be opened.
+int readBaseline(const char* filename, TimingEntry* entries, int capacity) {
+    FILE* file = fopen(filename, "r");
+    if (!file) {
+        fprintf(stderr, "Error opening file: %s\n", filename);
+        return -1;
+    }
+
+    int count = 0;
+    char line[512];
+    while (count < capacity && fgets(line, sizeof(line), file)) {
+        TimingEntry* e = &entries[count];
+        if (sscanf(line, " {\"dataset\": \"%63[^\"]\", \"backend\": \"%63[^\"]\", \"ns_per_signal\": %lf",
+                   e->dataset, e->backend, &e->nsPerSignal) == 3) {
+            count++;
+        }
+    }
+    fclose(file);
+    return count;
+}
+
+int writeBaseline(const char* filename, const TimingEntry* entries, int count) {
+    FILE* file = fopen(filename, "w");
+    if (!file) {
+        fprintf(stderr, "Error opening file: %s\n", filename);
+        return 0;
+    }
+
+    fprintf(file, "{\n  \"timings\": [\n");
+    for (int i = 0; i < count; i++) {
+        fprintf(file, "    {\"dataset\": \"%s\", \"backend\": \"%s\", \"ns_per_signal\": %.1f}%s\n",
+                entries[i].dataset, entries[i].backend, entries[i].nsPerSignal, i + 1 < count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) == 0;
+}
+
+const TimingEntry* findTiming(const TimingEntry* entries, int count, const char* dataset, const char* backend) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(entries[i].dataset, dataset) == 0 && strcmp(entries[i].backend, backend) == 0) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+void addSyntheticDataset(Dataset* datasets, int* numDatasets, int count, int length, uint64_t seed) {
+    Dataset* d = &datasets[(*numDatasets)++];
+    snprintf(d->name, sizeof(d->name), "synthetic-%d", length);
+    d->count = count;
+    d->length = length;
+    d->signals = (float*)malloc((size_t)count * length * sizeof(float));
+    if (!d->signals) {
+        fprintf(stderr, "Memory allocation failed for synthetic signals\n");
+        exit(REGRESS_SETUP_FAILED);
+    }
+    for (int s = 0; s < count; s++) generateSignal(d->signals + (size_t)s * length, length, seed, s);
+}
+
+int main(int argc, char* argv[]) {
+    const char* filterFiles[3] = {
+        "CNN_layer_1_filter_weights.csv",
+        "CNN_layer_2_filter_weights.csv",
+        "CNN_layer_3_filter_weights.csv"
+    };
+    const char* biasFiles[3] = {
+        "CNN_layer_1_filter_bias.csv",
+        "CNN_layer_2_filter_bias.csv",
+        "CNN_layer_3_filter_bias.csv"
+    };
+
+    const char* modelFile = NULL;
+    const char* inputFile = "test.csv";
+    const char* baselineFile = NULL;
+    const char* saveFile = NULL;
+    int signals = 200;
+    unsigned long long seed = 1;
+    long maxUlp = 4;
+    double maxAbs = 1e-6;
+    int reps = 5;
+    double slowdown = 15.0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
+            modelFile = argv[++i];
+        } else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            inputFile = argv[++i];
+        } else if (strcmp(argv[i], "--signals") == 0 && i + 1 < argc) {
+            signals = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--ulp") == 0 && i + 1 < argc) {
+            maxUlp = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--abs") == 0 && i + 1 < argc) {
+            maxAbs = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+            reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baselineFile = argv[++i];
+        } else if (strcmp(argv[i], "--save-baseline") == 0 && i + 1 < argc) {
+            saveFile = argv[++i];
+        } else if (strcmp(argv[i], "--slowdown") == 0 && i + 1 < argc) {
+            slowdown = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [--model file] [--input csv] [--signals N] [--seed N] [--ulp N] [--abs x] "
+                            "[--reps N] [--baseline file] [--save-baseline file] [--slowdown percent]\n", argv[0]);
+            return REGRESS_SETUP_FAILED;
+        }
+    }
+    if (signals <= 0 || reps <= 0 || maxUlp < 0 || maxAbs < 0 || slowdown < 0) {
+        fprintf(stderr, "Signals and reps must be positive, tolerances non-negative\n");
+        return REGRESS_SETUP_FAILED;
+    }
+
+    Model model;
+    int loaded = modelFile ? loadModelBinary(&model, modelFile)
+                           : loadModelFromCSV(&model, 3, filterFiles, biasFiles, 2, 5, 1, 5);
+    if (!loaded) {
+        fprintf(stderr, "Failed to load the model\n");
+        return REGRESS_SETUP_FAILED;
+    }
+    packModel(&model);
+
+    TimingEntry baseline[REGRESS_MAX_ENTRIES];
+    int baselineCount = 0;
+    if (baselineFile) {
+        baselineCount = readBaseline(baselineFile, baseline, REGRESS_MAX_ENTRIES);
+        if (baselineCount < 0) {
+            freeModel(&model);
+            return REGRESS_SETUP_FAILED;
+        }
+    }
+
+    Dataset datasets[3];
+    int numDatasets = 0;
+    if (access(inputFile, R_OK) == 0) {
+        Matrix* input = readMatrixFromCSVMapped(inputFile);
+        if (input && input->cols > 0) {
+            Dataset* d = &datasets[numDatasets++];
+            snprintf(d->name, sizeof(d->name), "%s", inputFile);
+            d->count = 1;
+            d->length = input->cols;
+            d->signals = (float*)malloc(input->cols * sizeof(float));
+            if (!d->signals) {
+                fprintf(stderr, "Memory allocation failed for input signal\n");
+                exit(REGRESS_SETUP_FAILED);
+            }
+            memcpy(d->signals, input->data[0], input->cols * sizeof(float));
+        }
+        freeMatrix(input);
+    } else {
+        fprintf(stderr, "Skipping missing input %s\n", inputFile);
+    }
+    addSyntheticDataset(datasets, &numDatasets, signals, 1800, seed);
+    addSyntheticDataset(datasets, &numDatasets, signals / 10 > 0 ? signals / 10 : 1, 18000, seed);
+
+    TimingEntry timings[REGRESS_MAX_ENTRIES];
+    int numTimings = 0;
+    int accuracyFailed = 0;
+    int performanceFailed = 0;
+
+    printf("tolerance %ld ulp or %g absolute; slowdown limit %.1f%%\n\n", maxUlp, maxAbs, slowdown);
+    printf("%-16s %-10s %8s %12s %10s %8s %12s %12s %8s  %s\n", "dataset", "backend", "signals", "max abs",
+           "max ulp", "bad", "ns/signal", "baseline", "change", "result");
+
+    for (int d = 0; d < numDatasets; d++) {
+        Dataset* set = &datasets[d];
+        Workspace* ws = createWorkspace(&model, set->length);
+        if (!ws) {
+            fprintf(stderr, "The model cannot take %s (%d samples)\n", set->name, set->length);
+            accuracyFailed = 1;
+            continue;
+        }
+        size_t outputSize = (size_t)set->count * ws->numChains * ws->outputLength;
+        float* expected = (float*)malloc(outputSize * sizeof(float));
+        float* actual = (float*)malloc(outputSize * sizeof(float));
+        double* samples = (double*)malloc(reps * sizeof(double));
+        if (!expected || !actual || !samples) {
+            fprintf(stderr, "Memory allocation failed for regression outputs\n");
+            exit(REGRESS_SETUP_FAILED);
+        }
+
+        for (int b = 0; b < NUM_BACKENDS; b++) {
+            float* output = b == 0 ? expected : actual;
+            for (int r = 0; r < reps; r++) {
+                long runs = 0;
+                long long start = regressNanoseconds();
+                long long elapsed;
+                do {
+                    backends[b].run(&model, ws, set->signals, set->count, output);
+                    runs++;
+                    elapsed = regressNanoseconds() - start;
+                } while (elapsed < REGRESS_MIN_SAMPLE_NS);
+                samples[r] = (double)elapsed / ((double)runs * set->count);
+            }
+            qsort(samples, reps, sizeof(double), compareDoubles);
+            double nsPerSignal = samples[reps / 2];
+
+            int ok = 1;
+            char accuracy[64] = "";
+            if (b == 0) {
+                snprintf(accuracy, sizeof(accuracy), "%12s %10s %8s", "-", "-", "-");
+            } else {
+                double worstAbs = 0;
+                int64_t worstUlp = 0;
+                long bad = 0;
+                for (size_t i = 0; i < outputSize; i++) {
+                    float e = expected[i];
+                    float a = actual[i];
+                    if (isnan(e) || isnan(a)) {
+                        if (isnan(e) != isnan(a)) bad++;
+                        continue;
+                    }
+                    double diff = fabs((double)a - e);
+                    int64_t ulp = ulpDistance(a, e);
+                    if (diff > worstAbs) worstAbs = diff;
+                    if (ulp > worstUlp) worstUlp = ulp;
+                    if (ulp > maxUlp && diff > maxAbs) bad++;
+                }
+                snprintf(accuracy, sizeof(accuracy), "%12.3g %10lld %8ld", worstAbs, (long long)worstUlp, bad);
+                if (bad) {
+                    ok = 0;
+                    accuracyFailed = 1;
+                }
+            }
+
+            char comparison[64];
+            const TimingEntry* previous = findTiming(baseline, baselineCount, set->name, backends[b].name);
+            if (previous && previous->nsPerSignal > 0) {
+                double change = (nsPerSignal / previous->nsPerSignal - 1.0) * 100.0;
+                snprintf(comparison, sizeof(comparison), "%12.1f %7.1f%%", previous->nsPerSignal, change);
+                if (change > slowdown) {
+                    ok = 0;
+                    performanceFailed = 1;
+                }
+            } else {
+                snprintf(comparison, sizeof(comparison), "%12s %8s", "-", "-");
+            }
+
+            printf("%-16s %-10s %8d %s %12.1f %s  %s\n", set->name, backends[b].name, set->count, accuracy,
+                   nsPerSignal, comparison, ok ? "ok" : "FAIL");
+
+            if (numTimings < REGRESS_MAX_ENTRIES) {
+                TimingEntry* t = &timings[numTimings++];
+                snprintf(t->dataset, sizeof(t->dataset), "%.63s", set->name);
+                snprintf(t->backend, sizeof(t->backend), "%s", backends[b].name);
+                t->nsPerSignal = nsPerSignal;
+            }
+        }
+
+        free(samples);
+        free(actual);
+        free(expected);
+        freeWorkspace(ws, &model);
+    }
+
+    int saveFailed = 0;
+    if (saveFile && !writeBaseline(saveFile, timings, numTimings)) {
+        fprintf(stderr, "Failed to write baseline %s\n", saveFile);
+        saveFailed = 1;
+    }
+
+    for (int d = 0; d < numDatasets; d++) free(datasets[d].signals);
+    freeModel(&model);
+
+    if (accuracyFailed) printf("\nAccuracy regression: outputs differ from the reference beyond tolerance\n");
+    if (performanceFailed) printf("\nPerformance regression: slower than the baseline beyond the limit\n");
+    return (accuracyFailed ? 1 : 0) | (performanceFailed ? 2 : 0) | (saveFailed ? REGRESS_SETUP_FAILED : 0);
+}